@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glob.h>
+
+#include "batch.h"
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "stats.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* COLLECT ------------------------------------------------------------------ */
+
+static void listDirectory(const std::string& dir, std::vector<std::string>& files)
+{
+    // add all regular files of dir; directory order is unspecified → sort
+    std::vector<std::string> entries;
+    for (const auto& e : std::filesystem::directory_iterator(dir))
+        if (e.is_regular_file())
+            entries.push_back(e.path().string());
+
+    std::sort(entries.begin(), entries.end());
+    files.insert(files.end(), entries.begin(), entries.end());
+}
+
+static void expandGlob(const std::string& pattern, std::vector<std::string>& files)
+{
+    // NOTE: glob(3) returns matches in sorted order
+    glob_t g;
+    if (::glob(pattern.c_str(), 0, nullptr, &g) == 0)
+        for (size_t k = 0; k < g.gl_pathc; k++)
+            files.push_back(g.gl_pathv[k]);
+
+    ::globfree(&g);
+}
+
+std::vector<std::string> collectFiles(const std::vector<std::string>& args)
+{
+    std::vector<std::string> files;
+
+    for (const std::string& arg : args)
+    {
+        // file list: one path per line, empty lines are skipped
+        if (!arg.empty() && arg[0] == '@')
+        {
+            std::ifstream list(arg.substr(1));
+            if (!list.is_open())
+                throw std::runtime_error("unable to open file list " + arg.substr(1));
+
+            std::string line;
+            while (std::getline(list, line))
+                if (!line.empty())
+                    files.push_back(line);
+        }
+        else if (std::filesystem::is_directory(arg))
+            listDirectory(arg, files);
+
+        // pattern the shell did not expand (e.g. quoted)
+        else if (arg.find_first_of("*?[") != std::string::npos && !std::filesystem::exists(arg))
+            expandGlob(arg, files);
+
+        // anything else is taken as is; errors are reported per file
+        else
+            files.push_back(arg);
+    }
+
+    return files;
+}
+
+
+/* PROCESS ------------------------------------------------------------------ */
+
+Result processFile(const std::string& filename, bool decode)
+{
+    Result r;
+
+    // set header attribute
+    r.header.setFN(filename);
+    Stats::add(Counter::FILES);
+
+    try {
+        // map file into memory; the mapping is released on return
+        StageTimer open(Stage::OPEN);
+        MappedFile file(filename);
+        open.stop();
+
+        LOG_INFO("processFile: mapped file " << filename << " successfully!");
+
+        // get ETX byte position
+        StageTimer etx(Stage::ETX);
+        long etxIndex = findETX(file.data(), file.size());
+        etx.stop();
+        if (etxIndex < 0)
+            throw std::invalid_argument("no ETX byte in " + filename);
+
+        // parse header from a view of the header bytes; no bytes are copied
+        StageTimer parse(Stage::PARSE);
+        parseHeader(getHeader(file, etxIndex), r.header);
+        parse.stop();
+        r.etxIndex = etxIndex;
+        Stats::add(Counter::BYTES_READ, etxIndex + 1);
+
+        if (decode) {
+            StageTimer decoding(Stage::DECODE);
+            Grid g = decodeGrid(file, etxIndex, r.header);
+            decoding.stop();
+            Stats::add(Counter::BYTES_READ, payloadBytes(r.header));
+
+            StageTimer summary(Stage::SUMMARIZE);
+            r.summary = summarize(g);
+            r.decoded = true;
+        }
+    }
+    catch (const std::runtime_error& e) {
+        LOG_ERROR("processFile: " << e.what());
+        r.error = "Could not open file " + filename;
+        Stats::add(Counter::ERRORS);
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("processFile: " << e.what());
+        r.error = "Could not parse file " + filename + ": " + e.what();
+        Stats::add(Counter::ERRORS);
+    }
+
+    return r;
+}
+
+
+/* WORKER POOL -------------------------------------------------------------- */
+
+unsigned workerCount(unsigned jobs, size_t n)
+{
+    // one worker per core, but never more workers than items
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(1, n)));
+}
+
+
+/* BATCH -------------------------------------------------------------------- */
+
+std::vector<Result> processBatch(const std::vector<std::string>& files, bool decode, unsigned jobs)
+{
+    std::vector<Result> results(files.size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    // each result slot is written by exactly one worker → no further 
+    // synchronization required
+    parallelFor(files.size(), jobs, [&](size_t k) {
+        results[k] = processFile(files[k], decode);
+    });
+
+    [[maybe_unused]] double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("processBatch: " << files.size() << " files on " << workerCount(jobs, files.size()) << " threads in " << s << "s (" << (s > 0 ? files.size() / s : 0) << " files/s)");
+
+    // deterministic order independent of scheduling
+    sortResults(results);
+
+    return results;
+}
+
+
+void sortResults(std::vector<Result>& results)
+{
+    // PI, then TS, then VV, then name
+    std::stable_sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+        if (a.header.getPI() != b.header.getPI())
+            return a.header.getPI() < b.header.getPI();
+        if (a.header.getTS() != b.header.getTS())
+            return a.header.getTS() < b.header.getTS();
+        if (a.header.getVV() != b.header.getVV())
+            return a.header.getVV() < b.header.getVV();
+        return a.header.getFN() < b.header.getFN();
+    });
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "classes.h"
+#include "payload.h"
+
+
+/* RESULT ------------------------------------------------------------------- */
+
+// outcome of processing a single file; `error` is empty on success
+
+struct Result {
+    Header header;
+    long etxIndex = -1;
+    Summary summary;
+    bool decoded = false;
+    std::string error;
+};
+
+
+/* WORKER POOL -------------------------------------------------------------- */
+
+// number of worker threads for `jobs` (0: one per core), at most n
+unsigned workerCount(unsigned jobs, size_t n);
+
+// call f(k) for k = 0..n-1 on `jobs` worker threads (0: one per core); workers
+// pull the next k from a shared counter, the calling thread works, too. The
+// first exception thrown by f stops all workers and is rethrown to the caller.
+template <class F>
+void parallelFor(size_t n, unsigned jobs, F f)
+{
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex errorLock;
+
+    auto worker = [&]() {
+        try {
+            for (size_t k = next++; k < n; k = next++)
+                f(k);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(errorLock);
+            if (!error)
+                error = std::current_exception();
+            next = n; // no further items
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < workerCount(jobs, n); t++)
+        pool.emplace_back(worker);
+
+    worker();
+
+    for (auto& t : pool)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+/* BATCH -------------------------------------------------------------------- */
+
+// expand arguments into a list of files: directories are listed (regular files
+// only, sorted by name), `@list` reads one path per line from file `list`, and
+// glob patterns are expanded if the shell did not already do so
+std::vector<std::string> collectFiles(const std::vector<std::string>& args);
+
+// run the whole pipeline (map, find ETX, parse, optionally decode) on one file
+Result processFile(const std::string& filename, bool decode);
+
+// process files on `jobs` worker threads (0: one per core); the results are
+// sorted by PI, then TS, then VV, then file name
+std::vector<Result> processBatch(const std::vector<std::string>& files, bool decode, unsigned jobs);
+
+// sort results by PI, then TS, then VV, then file name (stable), i.e. the runs
+// of each product are contiguous
+void sortResults(std::vector<Result>& results);
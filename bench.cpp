@@ -0,0 +1,705 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "check.h"
+#include "classes.h"
+#include "cube.h"
+#include "delta.h"
+#include "geo.h"
+#include "output.h"
+#include "payload.h"
+#include "products.h"
+#include "prv.h"
+#include "query.h"
+#include "scan.h"
+#include "serve.h"
+#include "sparse.h"
+#include "stats.h"
+#include "stream.h"
+#include "tiles.h"
+#include "traits.h"
+#include "utils.h"
+#include "zones.h"
+
+using namespace std;
+
+/*
+ * Benchmark suite for prvh: `make bench` builds and runs it.
+ *
+ * Each benchmark is repeated until it ran for at least `--min-time` seconds
+ * and reports one JSON object per line, e.g.
+ *
+ *  {"name":"findETX/sample","iterations":...,"ns_per_op":...,
+ *   "bytes_per_sec":...,"allocs_per_op":...,"files_per_sec":...}
+ *
+ * so runs of two builds can be compared with any JSON tool.
+ *
+ * `--check` (`make check`) instead asserts the allocation-free paths: it
+ * parses every header once and exits with status 1 if any heap allocation
+ * happened in between.
+ */
+
+
+/* ALLOCATION COUNTER ------------------------------------------------------- */
+
+// replace global operator new to count heap allocations of the whole process
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t n)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+
+/* HARNESS ------------------------------------------------------------------ */
+
+// keep the compiler from optimizing away a result that is otherwise unused
+template <class T>
+static inline void keep(const T& value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+static double minTime = 0.5;
+
+template <class F>
+static void run(const std::string& name, double bytesPerOp, double filesPerOp, F op)
+{
+    using clock = std::chrono::steady_clock;
+
+    // warm up (page cache, kernel selection, lazy statics)
+    op();
+
+    // double the batch size until one batch takes at least minTime
+    size_t n = 1;
+    for (;;)
+    {
+        size_t a0 = allocations.load();
+        auto t0 = clock::now();
+
+        for (size_t k = 0; k < n; k++)
+            op();
+
+        double s = std::chrono::duration<double>(clock::now() - t0).count();
+        size_t a = allocations.load() - a0;
+
+        if (s >= minTime || n >= (size_t(1) << 40))
+        {
+            double ns = s * 1e9 / n;
+            std::printf("{\"name\":\"%s\",\"iterations\":%zu,\"ns_per_op\":%.2f,\"bytes_per_sec\":%.0f,\"allocs_per_op\":%.3f,\"files_per_sec\":%.2f}\n",
+                name.c_str(), n, ns, bytesPerOp * n / s, double(a) / n, filesPerOp * n / s);
+            std::fflush(stdout);
+            return;
+        }
+        n *= 2;
+    }
+}
+
+
+/* SYNTHETIC INPUT ---------------------------------------------------------- */
+
+// products with a field table besides RV (see traits.h)
+static const char* const PRODUCTS[] = {"RW", "RY", "YW", "RX"};
+
+static std::string syntheticHeader(size_t textLen, std::string_view pi = "RV")
+{
+    // a valid header of product pi following the format description, with a
+    // station list of textLen bytes and terminated by ETX
+    std::string text = "<";
+    while (text.size() + 6 < textLen)
+        text += "deabc,";
+    text.resize(textLen - 1, 'x');
+    text += ">";
+
+    char ms[4];
+    std::snprintf(ms, sizeof(ms), "%3zu", textLen);
+
+    // the keyed fields of each product, in the order of its field table
+    std::string fields;
+    if (pi == "RV")
+        fields = "BY2640192VS 3SW P200003HPR E-02INT   5GP1200x1100VV 000MF 00000008";
+    else if (pi == "RW")
+        fields = "BY1620096VS 3SW P200003HPR E-01INT  60GP 900x 900MF 00000000";
+    else if (pi == "RY")
+        fields = "BY1620096VS 3SW P200003HPR E-02INT   5GP 900x 900MF 00000000";
+    else if (pi == "YW")
+        fields = "BY1980102VS 3SW P200003HPR E-02INT   5GP1100x 900VV 000MF 00000002";
+    else if (pi == "RX")
+        fields = "BY0810085VS 3SW P200003HPR E+00INT   5GP 900x 900";
+
+    return std::string(pi) + "242045" + "10000" + "0821" + fields + "MS" + ms + text + '\x03';
+}
+
+
+static std::string syntheticTar(const std::vector<std::string>& files)
+{
+    // minimal ustar archive of the given files, for the stream benchmarks
+    std::string tar;
+
+    for (const std::string& path : files)
+    {
+        MappedFile f(path);
+        char h[512] = {};
+
+        std::snprintf(h, 100, "%s", std::filesystem::path(path).filename().c_str());
+        std::snprintf(h + 100, 8, "%07o", 0644);
+        std::snprintf(h + 124, 12, "%011zo", f.size());
+        std::memcpy(h + 148, "        ", 8);
+        h[156] = '0';
+        std::memcpy(h + 257, "ustar", 6);
+        std::memcpy(h + 263, "00", 2);
+
+        unsigned sum = 0;
+        for (unsigned char c : h)
+            sum += c;
+        std::snprintf(h + 148, 8, "%06o", sum);
+
+        tar.append(h, 512);
+        tar.append(f.data(), f.size());
+        tar.append((512 - f.size() % 512) % 512, '\0');
+    }
+
+    tar.append(1024, '\0');
+    return tar;
+}
+
+
+/* ALLOCATION CHECK --------------------------------------------------------- */
+
+// parseHeader and prv::parseHeader of each header must not allocate; returns
+// the number of failures
+static int checkAllocations(const std::vector<std::string>& files)
+{
+    int failures = 0;
+
+    auto expect = [&](const std::string& name, auto op) {
+        size_t a0 = allocations.load();
+        op();
+        size_t a = allocations.load() - a0;
+        std::printf("%-40s %zu allocations%s\n", name.c_str(), a, a ? "  FAILED" : "");
+        failures += a != 0;
+    };
+
+    for (size_t textLen : {103, 999})
+    {
+        const std::string hb = syntheticHeader(textLen);
+        std::string_view header(hb.data(), findETX(hb.data(), hb.size()));
+
+        expect("parseHeader/synthetic" + std::to_string(textLen), [&]() {
+            Header h;
+            parseHeader(header, h);
+            keep(h);
+        });
+    }
+
+    // every other field table, through the withProduct dispatch
+    for (const char* pi : PRODUCTS)
+    {
+        const std::string hb = syntheticHeader(103, pi);
+        std::string_view header(hb.data(), findETX(hb.data(), hb.size()));
+
+        expect(std::string("parseHeader/synthetic103/") + pi, [&]() {
+            Header h;
+            parseHeader(header, h);
+            keep(h);
+        });
+
+        expect(std::string("prv::parseHeader/synthetic103/") + pi, [&]() {
+            Header h;
+            prv::Bytes payload;
+            keep(prv::parseHeader(prv::Bytes(hb.data(), hb.size()), h, payload));
+        });
+    }
+
+    for (const std::string& path : files)
+    {
+        MappedFile f(path);
+        long etx = findETX(f.data(), f.size());
+        std::string name = std::filesystem::path(path).filename().string();
+
+        expect("parseHeader/" + name, [&]() {
+            Header h;
+            parseHeader(getHeader(f, etx), h);
+            keep(h);
+        });
+
+        expect("prv::parseHeader/" + name, [&]() {
+            Header h;
+            prv::Bytes payload;
+            keep(prv::parseHeader(prv::Bytes(f.data(), f.size()), h, payload));
+        });
+    }
+
+    return failures;
+}
+
+
+/* MAIN --------------------------------------------------------------------- */
+
+int main(int argc, char* argv[])
+{
+    std::string dir = "DE1200_RV_LATEST";
+    bool check = false;
+
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--min-time" && a+1 < argc)
+            minTime = std::atof(argv[++a]);
+        else if (arg == "--check")
+            check = true;
+        else
+            dir = arg;
+    }
+
+    std::vector<std::string> files = collectFiles({dir});
+    if (files.empty()) {
+        std::cerr << "No sample files in " << dir << std::endl;
+        return 1;
+    }
+
+    if (check)
+        return checkAllocations(files) ? 1 : 0;
+
+
+    /* synthetic headers ---------------------------------------------------- */
+
+    for (size_t textLen : {103, 999})
+    {
+        const std::string hb = syntheticHeader(textLen);
+        const std::string tag = "/synthetic" + std::to_string(textLen);
+        long etx = findETX(hb.data(), hb.size());
+        std::string_view header(hb.data(), etx);
+
+        run("findETX" + tag, etx + 1, 0, [&]() {
+            keep(findETX(hb.data(), hb.size()));
+        });
+
+        run("parse" + tag, 0, 0, [&]() {
+            // all nine key-value pairs after the positional part
+            long i = 17;
+            for (size_t j = 0; j < METAINFO_SIZE; j++) {
+                auto [m, v] = parse(header, i);
+                keep(v);
+                i += m->getLen();
+            }
+        });
+
+        run("parseHeader" + tag, etx, 0, [&]() {
+            Header h;
+            parseHeader(header, h);
+            keep(h);
+        });
+    }
+
+    for (const char* pi : PRODUCTS)
+    {
+        const std::string hb = syntheticHeader(103, pi);
+        long etx = findETX(hb.data(), hb.size());
+        std::string_view header(hb.data(), etx);
+
+        run(std::string("parseHeader/synthetic103/") + pi, etx, 0, [&]() {
+            Header h;
+            parseHeader(header, h);
+            keep(h);
+        });
+    }
+
+
+    /* sample files --------------------------------------------------------- */
+
+    {
+        MappedFile f(files[0]);
+        long etx = findETX(f.data(), f.size());
+
+        run("findETX/sample", etx + 1, 0, [&]() {
+            keep(findETX(f.data(), f.size()));
+        });
+
+        run("getHeader/sample", 0, 0, [&]() {
+            keep(getHeader(f, etx));
+        });
+
+        run("parseHeader/sample", etx, 0, [&]() {
+            Header h;
+            parseHeader(getHeader(f, etx), h);
+            keep(h);
+        });
+
+        Header h;
+        parseHeader(getHeader(f, etx), h);
+        Grid g(h.getRows(), h.getCols());
+
+        run(std::string("decodePayload/") + decodeKernel(), g.getSize() * 2.0, 0, [&]() {
+            decodePayload(f.data() + etx + 1, g.getSize(), h.getFactor(), g.getValues(), g.getMask());
+            keep(g.getValues()[0]);
+        });
+
+        // RX reflectivity: one RVP6 byte per pixel, as many pixels as RV
+        std::vector<char> rvp6(g.getSize());
+        for (size_t i = 0; i < rvp6.size(); i++)
+            rvp6[i] = char(i % 7 == 0 ? RVP6_NODATA : i % 251);
+        run("decodeRVP6/synthetic", double(rvp6.size()), 0, [&]() {
+            decodeRVP6(rvp6.data(), rvp6.size(), g.getValues(), g.getMask());
+            keep(g.getValues()[0]);
+        });
+
+        // the same through the product dispatch, as loadCube and sparse do
+        run("decodeProduct/RX", double(rvp6.size()), 0, [&]() {
+            decodeProduct("RX", rvp6.data(), rvp6.size(), 1.0f, g.getValues(), g.getMask());
+            keep(g.getValues()[0]);
+        });
+
+        // library API: no allocation, no exceptions
+        run("prv::parseHeader/sample", etx, 0, [&]() {
+            prv::Bytes payload;
+            keep(prv::parseHeader(prv::Bytes(f.data(), f.size()), h, payload));
+        });
+
+        prv::Bytes payload;
+        prv::parseHeader(prv::Bytes(f.data(), f.size()), h, payload);
+        run("prv::decodePayload/sample", g.getSize() * 2.0, 0, [&]() {
+            keep(prv::decodePayload(payload, h, g.getValues(), g.getMask()));
+        });
+
+        // sparse form: decode, expand and accumulate against the dense grid
+        run("decodeSparse/sample", g.getSize() * 2.0, 0, [&]() {
+            keep(decodeSparse(f.data() + etx + 1, h.getRows(), h.getCols(), h.getFactor()).getEntries());
+        });
+
+        SparseGrid sg = decodeSparse(f.data() + etx + 1, h.getRows(), h.getCols(), h.getFactor());
+        run("toDense/sample", g.getSize() * 2.0, 0, [&]() { keep(toDense(sg).getValues()[0]); });
+
+        std::vector<float> acc(g.getSize());
+        run("accumulate/sparse", g.getSize() * 2.0, 0, [&]() {
+            accumulate(sg, 1.0f, acc.data());
+            keep(acc[0]);
+        });
+        run("accumulate/dense", g.getSize() * 2.0, 0, [&]() {
+            const float* v = g.getValues();
+            const uint8_t* m = g.getMask();
+            for (size_t k = 0; k < g.getSize(); k++)
+                if (!(m[k] & FLAG_NODATA))
+                    acc[k] += v[k];
+            keep(acc[0]);
+        });
+
+        // serializers into /dev/null; bytes_per_sec counts the header bytes
+        int devnull = ::open("/dev/null", O_WRONLY);
+        {
+            Writer w(devnull);
+            for (auto [name, format] : {std::pair{"jsonl", Format::JSONL}, {"csv", Format::CSV}, {"bin", Format::BIN}})
+                run(std::string("writeRecord/") + name, etx, 1, [&]() { writeRecord(w, h, format); });
+        }
+        ::close(devnull);
+    }
+
+
+    /* end-to-end: what `prvh` does per file and per invocation ------------- */
+
+    double bytes = 0;
+    for (const std::string& f : files)
+        bytes += std::filesystem::file_size(f);
+
+    run("processFile/header", bytes / files.size(), 1, [&]() {
+        keep(processFile(files[0], false).header.getBY());
+    });
+
+    // the same with --stats on; processFile/header is the disabled case
+    Stats::enable(true);
+    run("processFile/header/stats", bytes / files.size(), 1, [&]() {
+        keep(processFile(files[0], false).header.getBY());
+    });
+    Stats::enable(false);
+
+    run("processFile/decode", bytes / files.size(), 1, [&]() {
+        keep(processFile(files[0], true).summary.wet);
+    });
+
+    run("processBatch/header", bytes, files.size(), [&]() {
+        keep(processBatch(files, false, 0).size());
+    });
+
+    run("processBatch/decode", bytes, files.size(), [&]() {
+        keep(processBatch(files, true, 0).size());
+    });
+
+    // integrity gate: files_per_sec is what matters, bytes are not read
+    run("checkFile/sample", 0, 1, [&]() {
+        keep(checkFile(files[0]).status);
+    });
+
+
+    /* archive scan: 4096 sparse copies of the first sample file ----------- */
+
+    {
+        // full size on paper, but only the header is ever written to disk
+        std::string dir = (std::filesystem::temp_directory_path() / "prvh-bench-archive").string();
+        std::filesystem::create_directories(dir);
+
+        MappedFile f(files[0]);
+        long etx = findETX(f.data(), f.size());
+        std::vector<std::string> archive;
+
+        for (int k = 0; k < 4096; k++) {
+            archive.push_back(dir + "/" + std::to_string(k));
+            int fd = ::open(archive.back().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || ::write(fd, f.data(), etx + 1) != etx + 1 || ::ftruncate(fd, f.size()) != 0)
+                std::perror("bench: archive");
+            ::close(fd);
+        }
+
+        double archiveBytes = double(f.size()) * archive.size();
+        for (IoBackend b : {IoBackend::MMAP, IoBackend::PREAD, IoBackend::URING})
+            run(std::string("scanBatch/header/") + ioBackendName(b), archiveBytes, archive.size(), [&]() {
+                keep(scanBatch(archive, false, b, 0).size());
+            });
+
+        std::filesystem::remove_all(dir);
+    }
+
+
+    /* streams: tar archives of the sample files, read in one pass -------- */
+
+    {
+        std::string tar = syntheticTar(files);
+
+        std::vector<char> bz(tar.size() + tar.size() / 100 + 600);
+        unsigned bzSize = static_cast<unsigned>(bz.size());
+        BZ2_bzBuffToBuffCompress(bz.data(), &bzSize, tar.data(), static_cast<unsigned>(tar.size()), 9, 0, 0);
+
+        std::string dir = std::filesystem::temp_directory_path().string();
+        std::FILE* out = std::fopen((dir + "/prvh-bench.tar").c_str(), "wb");
+        std::fwrite(tar.data(), 1, tar.size(), out);
+        std::fclose(out);
+        out = std::fopen((dir + "/prvh-bench.tar.bz2").c_str(), "wb");
+        std::fwrite(bz.data(), 1, bzSize, out);
+        std::fclose(out);
+
+        for (std::string name : {"tar", "tar.bz2"})
+        {
+            std::string path = dir + "/prvh-bench." + name;
+
+            run("processStream/" + name + "/header", bytes, files.size(), [&]() {
+                keep(processStream(path, false).size());
+            });
+
+            run("processStream/" + name + "/decode", bytes, files.size(), [&]() {
+                keep(processStream(path, true).size());
+            });
+
+            std::filesystem::remove(path);
+        }
+    }
+
+
+    /* forecast cube -------------------------------------------------------- */
+
+    std::vector<std::vector<Result>> runs = groupRuns(processBatch(files, false, 0));
+
+    run("loadCube/step", bytes, files.size(), [&]() {
+        keep(loadCube(runs[0], Layout::STEP_MAJOR, 0).getBytes());
+    });
+
+    run("loadCube/pixel", bytes, files.size(), [&]() {
+        keep(loadCube(runs[0], Layout::PIXEL_MAJOR, 0).getBytes());
+    });
+
+
+    /* derived products: bytes_per_sec counts the cube's values ------------- */
+
+    {
+        Cube step = loadCube(runs[0], Layout::STEP_MAJOR, 0);
+        Cube pixel = loadCube(runs[0], Layout::PIXEL_MAJOR, 0);
+        std::vector<float> thresholds = {1.0f, 5.0f, 10.0f};
+        Products out;
+        double cubeBytes = double(step.getSteps()) * step.getRows() * step.getCols() * sizeof(float);
+
+        run(std::string("reduceCube/step/") + reduceKernel(), cubeBytes, files.size(), [&]() {
+            reduceCube(step, thresholds, 0, out);
+            keep(out.reduceTime);
+        });
+
+        run("reduceCube/pixel", cubeBytes, files.size(), [&]() {
+            reduceCube(pixel, thresholds, 0, out);
+            keep(out.reduceTime);
+        });
+
+
+        /* zonal statistics: 500 regions, a raster of 25 x 20 tiles --------- */
+
+        const int rows = step.getRows();
+        const int cols = step.getCols();
+        std::vector<std::pair<uint32_t, uint32_t>> members;
+        for (int y = 0; y < rows; y++)
+            for (int x = 0; x < cols; x++)
+                members.emplace_back(uint32_t(1 + (y * 25 / rows) * 20 + x * 20 / cols), uint32_t(y * cols + x));
+
+        run("buildRegionIndex/500", 0, 0, [&]() {
+            keep(buildRegionIndex(rows, cols, members).getRegions());
+        });
+
+        RegionIndex regions = buildRegionIndex(rows, cols, members);
+
+        run("zonalStats/500/step", cubeBytes, files.size(), [&]() {
+            keep(zonalStats(step, regions, 0).size());
+        });
+
+        run("zonalStats/500/pixel", cubeBytes, files.size(), [&]() {
+            keep(zonalStats(pixel, regions, 0).size());
+        });
+
+
+        /* tile pyramid of one step, and the tile store over all steps ------- */
+
+        std::vector<Grid> levels;
+        double gridBytes = double(rows) * cols * sizeof(float);
+
+        run("buildPyramid/mean", gridBytes, 1, [&]() {
+            buildPyramid(step.getValues(), rows, cols, Aggregation::MEAN, levels);
+            keep(levels.size());
+        });
+
+        run("buildPyramid/max", gridBytes, 1, [&]() {
+            buildPyramid(step.getValues(), rows, cols, Aggregation::MAX, levels);
+            keep(levels.size());
+        });
+
+        // every tile stored after the warm-up: hashing and lookup only
+        std::string tileDir = (std::filesystem::temp_directory_path() / "prvh-bench-tiles").string();
+        {
+            TileCache tiles(tileDir);
+            run("tiles/run", cubeBytes, files.size(), [&]() {
+                for (int s = 0; s < step.getSteps(); s++) {
+                    buildPyramid(step.getValues() + size_t(s) * rows * cols, rows, cols, Aggregation::MEAN, levels);
+                    keep(tiles.update(levels).size());
+                }
+            });
+            std::printf("{\"name\":\"tiles/store\",\"written\":%zu,\"reused\":%zu}\n", tiles.getWritten(), tiles.getReused());
+        }
+        std::filesystem::remove_all(tileDir);
+    }
+
+
+    /* decoded cache: bytes_per_sec relative to the raw files ---------------- */
+
+    std::string cachePath = (std::filesystem::temp_directory_path() / "prvh-bench.prvc").string();
+    size_t cacheBytes = writeCache(runs[0], cachePath);
+
+    std::printf("{\"name\":\"cache/size\",\"raw_bytes\":%.0f,\"cache_bytes\":%zu,\"ratio\":%.1f}\n", bytes, cacheBytes, bytes / cacheBytes);
+
+    run("writeCache/run", bytes, files.size(), [&]() {
+        keep(writeCache(runs[0], cachePath));
+    });
+
+    run("loadCache/step", bytes, files.size(), [&]() {
+        keep(loadCache(cachePath, Layout::STEP_MAJOR, 0).getBytes());
+    });
+
+    run("loadCache/pixel", bytes, files.size(), [&]() {
+        keep(loadCache(cachePath, Layout::PIXEL_MAJOR, 0).getBytes());
+    });
+
+    std::filesystem::remove(cachePath);
+
+
+    /* deltas: the sample has one run, hence successive steps stand in ---- */
+
+    if (runs[0].size() > 1) {
+        const Result& base = runs[0][0];
+        const Result& target = runs[0][1];
+        std::vector<char> d = encodeDelta(base, target);
+
+        double targetBytes = double(target.header.getBY());
+        std::printf("{\"name\":\"delta/size\",\"raw_bytes\":%.0f,\"delta_bytes\":%zu,\"ratio\":%.1f}\n", targetBytes, d.size(), targetBytes / d.size());
+
+        run("encodeDelta/step", 2 * targetBytes, 1, [&]() {
+            keep(encodeDelta(base, target).size());
+        });
+
+        MappedFile f(std::string(base.header.getFN()));
+        std::vector<char> file;
+        run("applyDelta/step", targetBytes, 1, [&]() {
+            file.assign(f.data(), f.data() + f.size());
+            applyDelta(file, d.data(), d.size());
+            keep(file.size());
+        });
+    }
+
+
+    /* server: answers from memory, into /dev/null ------------------------ */
+
+    {
+        Snapshot snapshot(processBatch(files, false, 0), "", 0);
+        int devnull = ::open("/dev/null", O_WRONLY);
+        Writer w(devnull);
+
+        run("answerRequest/header", 0, 0, [&]() { answerRequest(snapshot, "HEADER RVlatest 5", w); });
+        run("answerRequest/point", 0, 0, [&]() { answerRequest(snapshot, "POINT RVlatest 239 311", w); });
+
+        w.flush();
+        ::close(devnull);
+    }
+
+
+    /* coordinates: table of the sample grid, 64k points over Germany ------- */
+
+    {
+        std::string dir = (std::filesystem::temp_directory_path() / "prvh-bench-coords").string();
+        std::filesystem::remove_all(dir);
+        CoordTable t = loadCoordTable(dir, 1200, 1100, 0);
+
+        run("readCoordTable/1200x1100", 0, 0, [&]() {
+            keep(readCoordTable(dir + "/1200x1100.prvg", gridDef(1200, 1100)).getBuckets());
+        });
+
+        // a fixed pseudo-random sequence (LCG), so runs are comparable
+        const size_t n = 65536;
+        std::vector<float> lats(n), lons(n);
+        uint32_t x = 1;
+        for (size_t i = 0; i < n; i++) {
+            x = x * 1664525u + 1013904223u;
+            lats[i] = 47.0f + 8.0f * float(x >> 8) / float(1 << 24);
+            x = x * 1664525u + 1013904223u;
+            lons[i] = 5.5f + 10.0f * float(x >> 8) / float(1 << 24);
+        }
+        std::vector<int32_t> rows(n), cols(n);
+
+        run("locate/65536", 0, n, [&]() {
+            t.locate(lats.data(), lons.data(), n, rows.data(), cols.data(), 1);
+            keep(rows[0]);
+        });
+
+        std::filesystem::remove_all(dir);
+    }
+
+
+    /* random access -------------------------------------------------------- */
+
+    run("queryPoint/run", 2.0 * runs[0].size(), 0, [&]() {
+        keep(queryPoint(runs[0], 239, 311)[0].getValues()[0]);
+    });
+
+    run("queryWindow/run/16x16", 512.0 * runs[0].size(), 0, [&]() {
+        keep(queryWindow(runs[0], 600, 500, 615, 515)[0].getValues()[0]);
+    });
+
+    return 0;
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "cache.h"
+#include "classes.h"
+#include "cube.h"
+#include "logger.h"
+#include "payload.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* ENCODING ----------------------------------------------------------------- */
+
+// one step as it is written: name and ASCII header, then either runs or the
+// raw payload bytes
+
+struct EncodedStep {
+    std::string name;
+    std::string header;
+    uint32_t encoding = CACHE_RAW;
+    std::vector<uint32_t> runs;
+    std::vector<char> raw;
+};
+
+static size_t align4(size_t n) { return (n + 3) & ~size_t(3); }
+
+static void encodeStep(const Result& r, size_t pixels, EncodedStep& e)
+{
+    const Header& h = r.header;
+    MappedFile f(std::string(h.getFN()));
+
+    long etxIndex = findETX(f.data(), f.size());
+    if (etxIndex < 0 || f.size() < size_t(etxIndex) + 1 + pixels * 2)
+        throw std::invalid_argument("writeCache: payload of " + std::string(h.getFN()) + " is incomplete!");
+
+    e.name = std::string(h.getFN());
+    e.header = std::string(getHeader(f, etxIndex));
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(f.data() + etxIndex + 1);
+
+    // collapse equal consecutive words; give up as soon as the runs would take
+    // at least as much space as the raw words
+    size_t limit = pixels / 2;
+
+    for (size_t i = 0; i < pixels && e.runs.size() < limit; )
+    {
+        uint16_t w = uint16_t(p[2*i] | (p[2*i+1] << 8));
+        size_t j = i + 1;
+
+        while (j < pixels && j - i < 0x10000 && uint16_t(p[2*j] | (p[2*j+1] << 8)) == w)
+            j++;
+
+        e.runs.push_back(uint32_t(w) | (uint32_t(j - i - 1) << 16));
+        i = j;
+    }
+
+    if (e.runs.size() < limit) {
+        e.encoding = CACHE_RLE;
+    }
+    else {
+        e.runs.clear();
+        e.raw.assign(f.data() + etxIndex + 1, f.data() + etxIndex + 1 + pixels * 2);
+    }
+}
+
+
+size_t writeCache(const std::vector<Result>& run, const std::string& path)
+{
+    if (run.empty())
+        throw std::invalid_argument("writeCache: run must contain at least one step!");
+
+    const Header& first = run[0].header;
+    size_t pixels = size_t(first.getRows()) * first.getCols();
+
+    // the run-length code works on pixel words
+    if (bytesPerPixel(first.getPI()) != 2)
+        throw std::invalid_argument("writeCache: product " + std::string(first.getPI()) + " has no pixel words!");
+
+    for (const Result& r : run)
+        if (r.header.getPI() != first.getPI() || r.header.getTS() != first.getTS() || r.header.getRows() != first.getRows() || r.header.getCols() != first.getCols())
+            throw std::invalid_argument("writeCache: " + std::string(r.header.getFN()) + " does not match run " + std::string(first.getTS()) + "!");
+
+    // encode all steps on the worker pool, then lay them out one after another
+    std::vector<EncodedStep> encoded(run.size());
+    parallelFor(run.size(), 0, [&](size_t s) { encodeStep(run[s], pixels, encoded[s]); });
+
+    CacheHeader ch = {};
+    std::memcpy(ch.magic, CACHE_MAGIC, sizeof(ch.magic));
+    ch.version = CACHE_VERSION;
+    ch.steps = static_cast<uint32_t>(run.size());
+    ch.rows = static_cast<uint32_t>(first.getRows());
+    ch.cols = static_cast<uint32_t>(first.getCols());
+
+    std::vector<CacheStep> steps(run.size());
+    size_t offset = sizeof(CacheHeader) + steps.size() * sizeof(CacheStep);
+
+    for (size_t s = 0; s < run.size(); s++)
+    {
+        const EncodedStep& e = encoded[s];
+        CacheStep& st = steps[s];
+
+        st.offset = offset;
+        st.nameLen = static_cast<uint32_t>(e.name.size());
+        st.headerLen = static_cast<uint32_t>(e.header.size());
+        st.encoding = e.encoding;
+        st.count = static_cast<uint32_t>(e.encoding == CACHE_RLE ? e.runs.size() : pixels);
+        st.payload = align4(offset + e.name.size() + e.header.size());
+
+        offset = align4(st.payload + (e.encoding == CACHE_RLE ? e.runs.size() * 4 : e.raw.size()));
+    }
+
+    // write to a temporary file and rename it, so readers never see half a cache
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("writeCache: unable to create " + tmp);
+
+        const char zeros[4] = {};
+        size_t pos = 0;
+        auto put = [&](const void* b, size_t n) { out.write(static_cast<const char*>(b), n); pos += n; };
+        auto pad = [&]() { put(zeros, align4(pos) - pos); };
+
+        put(&ch, sizeof(ch));
+        put(steps.data(), steps.size() * sizeof(CacheStep));
+
+        for (const EncodedStep& e : encoded)
+        {
+            put(e.name.data(), e.name.size());
+            put(e.header.data(), e.header.size());
+            pad();
+
+            if (e.encoding == CACHE_RLE)
+                put(e.runs.data(), e.runs.size() * 4);
+            else
+                put(e.raw.data(), e.raw.size());
+            pad();
+        }
+
+        if (!out)
+            throw std::runtime_error("writeCache: unable to write " + tmp);
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("writeCache: unable to rename " + tmp + " to " + path);
+    }
+
+    LOG_INFO("writeCache: run " << first.getTS() << " with " << run.size() << " steps to " << path << " (" << offset << " bytes)");
+
+    return offset;
+}
+
+
+/* LOADING ------------------------------------------------------------------ */
+
+static void expandStep(const MappedFile& f, const CacheStep& st, size_t pixels, float factor, float* values, uint8_t* mask)
+{
+    // NOTE: expects values and mask to be zero-initialized
+    const char* payload = f.data() + st.payload;
+
+    if (st.encoding == CACHE_RAW) {
+        // the raw words, as in the original file
+        decodePayload(payload, pixels, factor, values, mask);
+        return;
+    }
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    size_t i = 0;
+
+    for (uint32_t k = 0; k < st.count; k++)
+    {
+        uint32_t run;
+        std::memcpy(&run, payload + 4 * size_t(k), 4);
+
+        uint16_t w = uint16_t(run & 0xFFFF);
+        size_t n = size_t(run >> 16) + 1;
+
+        if (i + n > pixels)
+            throw std::invalid_argument("loadCache: runs exceed the grid!");
+
+        // same rules as the decode kernels, once per run
+        float v = (w & PIXEL_VALUE) * factor;
+        if (w & PIXEL_NEGATIVE)
+            v = -v;
+        if (w & PIXEL_NODATA)
+            v = nan;
+
+        // values and mask arrive zeroed, hence dry runs need no writes at all
+        if (w != 0) {
+            std::fill_n(values + i, n, v);
+            std::fill_n(mask + i, n, uint8_t(w >> 13));
+        }
+        i += n;
+    }
+
+    if (i != pixels)
+        throw std::invalid_argument("loadCache: runs do not cover the grid!");
+}
+
+
+Cube loadCache(const std::string& path, Layout layout, unsigned jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile f(path);
+
+    CacheHeader ch;
+    if (f.size() < sizeof(ch))
+        throw std::invalid_argument("loadCache: " + path + " is too small!");
+    std::memcpy(&ch, f.data(), sizeof(ch));
+
+    if (std::memcmp(ch.magic, CACHE_MAGIC, sizeof(ch.magic)) != 0 || ch.version != CACHE_VERSION)
+        throw std::invalid_argument("loadCache: " + path + " is not a cache file of version " + std::to_string(CACHE_VERSION) + "!");
+    if (ch.steps == 0 || f.size() < sizeof(ch) + size_t(ch.steps) * sizeof(CacheStep))
+        throw std::invalid_argument("loadCache: " + path + " is truncated!");
+
+    Cube c;
+    c.layout = Layout::STEP_MAJOR;
+    c.steps = static_cast<int>(ch.steps);
+    c.rows = static_cast<int>(ch.rows);
+    c.cols = static_cast<int>(ch.cols);
+
+    size_t pixels = size_t(c.rows) * c.cols;
+
+    // step table and headers; every range is checked before it is read
+    std::vector<CacheStep> steps(ch.steps);
+    std::memcpy(steps.data(), f.data() + sizeof(ch), steps.size() * sizeof(CacheStep));
+
+    c.headers.resize(steps.size());
+
+    for (size_t s = 0; s < steps.size(); s++)
+    {
+        const CacheStep& st = steps[s];
+        size_t payloadBytes = st.encoding == CACHE_RLE ? size_t(st.count) * 4 : pixels * 2;
+
+        if (st.offset + st.nameLen + st.headerLen > f.size() || st.payload + payloadBytes > f.size() || st.payload % 4 != 0 ||
+            (st.encoding != CACHE_RLE && st.encoding != CACHE_RAW))
+            throw std::invalid_argument("loadCache: step " + std::to_string(s) + " of " + path + " is malformed!");
+
+        Header& h = c.headers[s];
+        h.setFN(std::string(f.data() + st.offset, st.nameLen));
+        parseHeader(std::string_view(f.data() + st.offset + st.nameLen, st.headerLen), h);
+
+        if (h.getRows() != c.rows || h.getCols() != c.cols)
+            throw std::invalid_argument("loadCache: header of step " + std::to_string(s) + " does not match the grid of " + path + "!");
+
+        // as in `writeCache`: pixel words of one product and run only, else
+        // the payload would go through the wrong decoder
+        if (bytesPerPixel(h.getPI()) != 2)
+            throw std::invalid_argument("loadCache: product " + std::string(h.getPI()) + " of step " + std::to_string(s) + " in " + path + " has no pixel words!");
+        if (h.getPI() != c.headers[0].getPI() || h.getTS() != c.headers[0].getTS())
+            throw std::invalid_argument("loadCache: step " + std::to_string(s) + " of " + path + " does not match run " + std::string(c.headers[0].getTS()) + "!");
+    }
+
+    c.values.resize(pixels * c.steps);
+    c.mask.resize(pixels * c.steps);
+
+    parallelFor(steps.size(), jobs, [&](size_t s) {
+        expandStep(f, steps[s], pixels, c.headers[s].getFactor(), c.values.data() + s * pixels, c.mask.data() + s * pixels);
+    });
+
+    if (layout == Layout::PIXEL_MAJOR)
+        c.toPixelMajor(jobs);
+
+    c.loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_INFO("loadCache: run " << c.getTS() << " with " << c.steps << " steps from " << path << " in " << c.loadTime << "s");
+
+    return c;
+}
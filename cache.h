@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "cube.h"
+
+
+/* CACHE FORMAT ------------------------------------------------------------- */
+
+// A cache file (`.prvc`) holds one decoded run in a form that can be mapped and
+// expanded without touching the raw files again:
+//
+//  CacheHeader                    32 bytes
+//  CacheStep[steps]               32 bytes each, ordered by VV
+//  per step: file name, ASCII header (up to ETX), payload; 4-byte aligned
+//
+// The payload of a step is either a run-length encoding of the raw pixel words
+// (CACHE_RLE: one uint32 per run, low 16 bits the word, high 16 bits the run
+// length - 1) or, if that would not be smaller, the raw words (CACHE_RAW). Runs
+// keep the whole word, hence the flag bits 13-15 travel with the value and the
+// mask is restored exactly. On dry days most of the grid is a handful of long
+// runs of 0x0000 and 0x2000 (no data outside the radar coverage).
+//
+// NOTE: all numbers are stored in host byte order; a cache file written on a
+// big-endian host is rejected by the magic check on a little-endian one.
+
+const char CACHE_MAGIC[4] = {'P', 'R', 'V', 'C'};
+const uint32_t CACHE_VERSION = 1;
+
+const uint32_t CACHE_RAW = 0;
+const uint32_t CACHE_RLE = 1;
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t steps;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t reserved[3];
+};
+
+struct CacheStep {
+    uint64_t offset;        // of the file name, from the start of the cache
+    uint32_t nameLen;
+    uint32_t headerLen;     // ASCII header follows the name
+    uint32_t encoding;      // CACHE_RAW or CACHE_RLE
+    uint32_t count;         // number of payload uint32 (RLE) or uint16 (RAW)
+    uint64_t payload;       // offset of the payload, 4-byte aligned
+};
+
+static_assert(sizeof(CacheHeader) == 32 && sizeof(CacheStep) == 32, "CacheHeader/CacheStep: unexpected padding!");
+
+
+/* WRITING / LOADING -------------------------------------------------------- */
+
+// encode all steps of a run (see `groupRuns`) into the cache file at path;
+// returns the size of the cache file in bytes
+size_t writeCache(const std::vector<Result>& run, const std::string& path);
+
+// map the cache file at path and expand it into a cube, on `jobs` worker
+// threads (0: one per core); headers are parsed from the stored ASCII headers
+// and must all be of one run of a 2-byte product on the cached grid, else
+// std::invalid_argument is thrown
+Cube loadCache(const std::string& path, Layout layout, unsigned jobs);
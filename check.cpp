@@ -0,0 +1,105 @@
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "check.h"
+#include "classes.h"
+#include "logger.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* INTEGRITY ---------------------------------------------------------------- */
+
+const char* integrityName(Integrity i)
+{
+    switch (i)
+    {
+        case Integrity::OK: return "OK";
+        case Integrity::UNREADABLE: return "UNREADABLE";
+        case Integrity::NO_ETX: return "NO_ETX";
+        case Integrity::MALFORMED: return "MALFORMED";
+        case Integrity::SIZE_MISMATCH: return "SIZE_MISMATCH";
+        case Integrity::PAYLOAD_MISMATCH: return "PAYLOAD_MISMATCH";
+    }
+    return "UNKNOWN";
+}
+
+
+static Check fail(Check& c, Integrity status, const std::string& detail)
+{
+    c.status = status;
+    c.detail = detail;
+    LOG_ERROR("checkFile: " << c.file << ": " << detail);
+    return c;
+}
+
+Check checkFile(const std::string& filename)
+{
+    Check c;
+    c.file = filename;
+
+    // the header prefix; the payload is never touched
+    char buffer[HEADER_MAX];
+    ssize_t n = -1;
+    struct stat st;
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            n = ::pread(fd, buffer, sizeof(buffer), 0);
+        ::close(fd);
+    }
+    if (n < 0)
+        return fail(c, Integrity::UNREADABLE, "unable to read file");
+
+    c.size = size_t(st.st_size);
+
+    c.etxIndex = findETX(buffer, size_t(n));
+    if (c.etxIndex < 0)
+        return fail(c, Integrity::NO_ETX, "no ETX byte in the first " + std::to_string(n) + " bytes");
+
+    Header h;
+    try {
+        parseHeader(std::string_view(buffer, c.etxIndex), h);
+    }
+    catch (const std::exception& e) {
+        return fail(c, Integrity::MALFORMED, e.what());
+    }
+
+    if (size_t(h.getBY()) != c.size)
+        return fail(c, Integrity::SIZE_MISMATCH, "BY is " + std::to_string(h.getBY()) + " bytes, file has " + std::to_string(c.size));
+
+    size_t payload = c.size - size_t(c.etxIndex) - 1;
+    size_t expected = payloadBytes(h);
+    if (payload != expected)
+        return fail(c, Integrity::PAYLOAD_MISMATCH, "GP " + std::to_string(h.getRows()) + "x" + std::to_string(h.getCols()) + " needs " + std::to_string(expected) + " payload bytes, file has " + std::to_string(payload));
+
+    return c;
+}
+
+
+std::vector<Check> checkBatch(const std::vector<std::string>& files, unsigned jobs)
+{
+    std::vector<Check> checks(files.size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    parallelFor(files.size(), jobs, [&](size_t k) {
+        checks[k] = checkFile(files[k]);
+    });
+
+    [[maybe_unused]] double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("checkBatch: checked " << files.size() << " files in " << s << "s");
+
+    return checks;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/* INTEGRITY ---------------------------------------------------------------- */
+
+// Checks of one file that need only its size and the header prefix, i.e. one
+// `fstat` and one `pread` of at most HEADER_MAX bytes, no payload I/O:
+//  - NO_ETX: no ETX byte within the first HEADER_MAX bytes
+//  - MALFORMED: the header does not parse
+//  - SIZE_MISMATCH: BY (product length in bytes) differs from the file size
+//  - PAYLOAD_MISMATCH: the bytes after ETX are not GP rows x cols x 2
+// Truncated or partially uploaded files fail one of the last two.
+
+enum class Integrity { OK, UNREADABLE, NO_ETX, MALFORMED, SIZE_MISMATCH, PAYLOAD_MISMATCH };
+
+// e.g. "SIZE_MISMATCH"
+const char* integrityName(Integrity i);
+
+struct Check {
+    std::string file;
+    Integrity status = Integrity::OK;
+    size_t size = 0;
+    long etxIndex = -1;
+
+    // what failed, empty if OK
+    std::string detail;
+};
+
+Check checkFile(const std::string& filename);
+
+// check files on `jobs` worker threads (0: one per core), in input order
+std::vector<Check> checkBatch(const std::vector<std::string>& files, unsigned jobs);
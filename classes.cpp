@@ -1,8 +1,17 @@
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "utils.h"
 #include "classes.h"
 
@@ -10,28 +19,45 @@ using namespace std;
 
 /* HEADER ------------------------------------------------------------------- */
 
-// constructor A
-Header::Header() {}
+// constructor A: all text fields start out empty, i.e. filled with '\0'
+Header::Header() : 
+    productId{}, timestamp{}, wmo{}, by(0), vs(0), sw{}, pr{}, in(0), gp{}, 
+    rows(0), cols(0), vv(0), mf{}, ms(0), text{}, textLen(0) {}
 
 // destructor: for now empty, as no files opened, etc.
 Header::~Header() {}
 
+// reset all fields to their initial state, except the file name, which is set
+// by the caller before parsing; `text` is only read up to `textLen`, hence
+// resetting the length suffices (and spares clearing 999 bytes per parse)
+void Header::clear()
+{
+    memset(productId, 0, sizeof productId);
+    memset(timestamp, 0, sizeof timestamp);
+    memset(wmo, 0, sizeof wmo);
+    memset(sw, 0, sizeof sw);
+    memset(pr, 0, sizeof pr);
+    memset(gp, 0, sizeof gp);
+    memset(mf, 0, sizeof mf);
+    by = vs = in = rows = cols = vv = ms = textLen = 0;
+}
+
 
 /* to string - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -  */
 
 
 std::ostream& operator<<(std::ostream& os, const Header& h) {
     os << 
-        "ASCII Header of '" << h.filename << "'\n" <<
-        " PI:   " << h.productId << "\n" <<
-        " TS:   " << h.timestamp << "\n" <<
-        " WMO:  " << h.wmo << "\n" <<
-        " SW:   " << h.sw << "\n" <<
-        " PR:   " << h.pr << "\n" <<
-        " GP:   " << h.gp << "\n" <<
-        " MF:   " << h.mf << "\n" <<
+        "ASCII Header of '" << h.getFN() << "'\n" <<
+        " PI:   " << h.getPI() << "\n" <<
+        " TS:   " << h.getTS() << "\n" <<
+        " WMO:  " << h.getWN() << "\n" <<
+        " SW:   " << h.getSW() << "\n" <<
+        " PR:   " << h.getPR() << "\n" <<
+        " GP:   " << h.getGP() << "\n" <<
+        " MF:   " << h.getMF() << "\n" <<
         " MS:   " << h.ms << "\n" <<
-        " TX:   " << h.text;
+        " TX:   " << h.getText();
 
     return os;
 }
@@ -39,26 +65,44 @@ std::ostream& operator<<(std::ostream& os, const Header& h) {
 
 /* getter - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-const std::string Header::getFN() const { return filename; }
-const std::string Header::getPI() const { return productId; }
-const std::string Header::getTS() const { return timestamp; }
-const std::string Header::getWN() const { return wmo; }
-const std::string Header::getSW() const { return sw; }
-const std::string Header::getPR() const { return pr; }
-const std::string Header::getGP() const { return gp; }
-const std::string Header::getMF() const { return mf; }
-const std::string Header::getText() const { return text; }
+// view of an inline field up to its first '\0' (or its full width)
+template <size_t N>
+static std::string_view field(const char (&f)[N]) { return std::string_view(f, strnlen(f, N)); }
+
+std::string_view Header::getFN() const { return filename; }
+std::string_view Header::getPI() const { return field(productId); }
+std::string_view Header::getTS() const { return field(timestamp); }
+std::string_view Header::getWN() const { return field(wmo); }
+std::string_view Header::getSW() const { return field(sw); }
+std::string_view Header::getPR() const { return field(pr); }
+std::string_view Header::getGP() const { return field(gp); }
+std::string_view Header::getMF() const { return field(mf); }
+std::string_view Header::getText() const { return std::string_view(text, textLen); }
   
 const int Header::getBY() const { return by; }
 const int Header::getVS() const { return vs; }
 const int Header::getIN() const { return in; }
 const int Header::getVV() const { return vv; }
 const int Header::getMS() const { return ms; }
+const int Header::getRows() const { return rows; }
+const int Header::getCols() const { return cols; }
+
+const float Header::getFactor() const 
+{
+    // precision "E-02" → 10^-2; pixel values are multiplied by this factor
+    std::string_view p = getPR();
+    if (p.size() < 2 || p[0] != 'E')
+        return 1.0f;
+
+    int e = 0;
+    std::from_chars(p.data() + 1, p.data() + p.size(), e);
+    return std::pow(10.0f, e);
+}
 
 
 /* helpers - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -  */
 
-int Header::evalBufferSize(std::vector<char> b, int n)
+int Header::evalBufferSize(std::string_view b, size_t n)
 {
     // Check for expected number of bytes in argument b and throw exception.
     
@@ -71,6 +115,31 @@ int Header::evalBufferSize(std::vector<char> b, int n)
     return 0;
 }
 
+static int toInt(std::string_view b)
+{
+    // Parse a right-aligned decimal field (e.g. `   5`) without allocating.
+
+    // skip leading blanks; from_chars does not do this on its own
+    size_t k = b.find_first_not_of(' ');
+    if (k == std::string_view::npos)
+        throw std::invalid_argument("b must contain a number!");
+
+    int v = 0;
+    auto [end, ec] = std::from_chars(b.data() + k, b.data() + b.size(), v);
+    if (ec != std::errc() || end != b.data() + b.size())
+        throw std::invalid_argument("b must contain a number!");
+
+    return v;
+}
+
+template <size_t N>
+static void assign(char (&f)[N], std::string_view b)
+{
+    // copy b into the inline field f and pad the rest with '\0'
+    std::memset(f, 0, N);
+    std::memcpy(f, b.data(), std::min(b.size(), N));
+}
+
 
 /* "string" setter - - - - - - - - - - - - - - - - - - - - - - - - - - - - -  */
 
@@ -81,200 +150,188 @@ void Header::setFN(std::string s)
     return;
 }
 
-void Header::setPI(std::vector<char> b) 
+void Header::setPI(std::string_view b) 
 { 
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 2);
 
-    // cast bytes to string and assign attribute value
-    productId = std::string (b.begin(), b.end());
+    // copy bytes and assign attribute value
+    assign(productId, b);
     return;
 }
 
-void Header::setTS(char ts[]) 
+void Header::setTS(std::string_view ts) 
 {
     // ensure correct number of bytes in argument b
-    // NOTE: strlen does not include the \0 char in the count!
-    if (std::strlen(ts) != 10)
-        throw std::invalid_argument("b must be of size 11!");
+    evalBufferSize(ts, 10);
 
-    // cast from char array to string and assign attribute value;
-    timestamp = std::string(ts);
+    // copy bytes and assign attribute value
+    assign(timestamp, ts);
     return;
 }
 
-void Header::setWN(std::vector<char> b) 
+void Header::setWN(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 5);
 
-    // cast bytes to string and assign attribute value
-    wmo = std::string(b.begin(), b.end());
+    // copy bytes and assign attribute value
+    assign(wmo, b);
     return;
 }
 
-void Header::setSW(std::vector<char> b) 
+void Header::setSW(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 9);
 
-    // cast bytes to string and assign attribute value
-    sw = std::string(b.begin()+1, b.end()); // ignore leftmost byte!
+    // copy bytes and assign attribute value
+    assign(sw, b.substr(1)); // ignore leftmost byte!
     return;
 }
 
-void Header::setPR(std::vector<char> b) 
+void Header::setPR(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 5);
 
-    // cast bytes to string and assign attribute value
-    pr = std::string(b.begin()+1, b.end()); // ignore leftmost byte!
+    // copy bytes and assign attribute value
+    assign(pr, b.substr(1)); // ignore leftmost byte!
     return;
 }
 
-void Header::setGP(std::vector<char> b) 
+void Header::setGP(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 9);
 
-    // cast bytes to string and assign attribute value
-    gp = std::string(b.begin()+1, b.end()); // ignore leftmost byte!
+    // copy bytes and assign attribute value
+    // NOTE: the field is `rows x cols` and uses all 9 bytes (e.g. `1200x1100`)
+    assign(gp, b);
+
+    // split at 'x'; toInt skips leading blanks as in ` 900x 900`
+    size_t x = b.find('x');
+    if (x == std::string_view::npos)
+        throw std::invalid_argument("b must be of format <rows>x<cols>!");
+
+    rows = toInt(b.substr(0, x));
+    cols = toInt(b.substr(x+1));
     return;
 }
 
-void Header::setMF(std::vector<char> b) 
+void Header::setMF(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 9);
 
-    // cast bytes to string and assign attribute value
-    mf = std::string(b.begin()+1, b.end()); // ignore leftmost byte!
+    // copy bytes and assign attribute value
+    assign(mf, b.substr(1)); // ignore leftmost byte!
     return;
 }
 
 
 /* "int" setter - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
-void Header::setBY(std::vector<char> b) 
+void Header::setBY(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 7);
 
-    // init string variable for storing interim result
-    std::string s = "0";
-
-    for (int i=0; i<b.size(); i++)
-        s[i] = b[i];
-
-    // cast from string to int
-    by = std::stoi(s);
+    // parse digits in place
+    by = toInt(b);
     return;
 }
 
-void Header::setVS(std::vector<char> b) 
+void Header::setVS(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 2);
 
-    // init string variable for storing interim result
-    std::string s = "0";
-
-    for (int i=0; i<b.size(); i++)
-        s[i] = b[i];
-
-    // cast from string to int
-    vs = std::stoi(s);
+    // parse digits in place
+    vs = toInt(b);
     return;
 }
 
-void Header::setIN(std::vector<char> b) 
+void Header::setIN(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 4);
 
-    // init string variable for storing interim result
-    std::string s = "0";
-
-    for (int i=0; i<b.size(); i++)
-        s[i] = b[i];
-
-    // cast from string to int
-    vs = std::stoi(s);
+    // parse digits in place
+    in = toInt(b);
     return;
 }
 
-void Header::setVV(std::vector<char> b) 
+void Header::setVV(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 4);
 
-    // init string variable for storing interim result
-    std::string s = "0";
-
-    // VW identifier yields 4 bytes, of which the leftmost is IGNORED! hence, 
-    // the loop starts at 0; however, s is a regular string starting at index 0.
-    // Therefore, we counter the index-shift when assigning values to s!
-
-    for (int i=1; i<b.size(); i++) // NOTE: index shift to ignore first byte!
-        s[i-1] = b[i]; // NOTE: counter index shift in assignment
-
-    // cast from string to int
-    vv = std::stoi(s);
+    // VV identifier yields 4 bytes, of which the leftmost is IGNORED!
+    vv = toInt(b.substr(1));
     return;
 }
 
-
-
-void Header::setMS(std::vector<char> b) 
+void Header::setMS(std::string_view b) 
 {
     // ensure correct number of bytes in argument b
     evalBufferSize(b, 3);
 
-    // init string variable for storing interim result
-    std::string s = "0";
-
-    for (int i=0; i<b.size(); i++)
-        s[i] = b[i];
-
-    // cast from string to int
-    ms = std::stoi(s);
+    // parse digits in place
+    ms = toInt(b);
     return;
 }
 
-void Header::setText(std::string s)
+void Header::setText(std::string_view b)
 {
-    text = s;
+    // ensure text fits into the inline buffer
+    if (b.size() > sizeof(text))
+        throw std::invalid_argument("b must be of size <= " + std::to_string(sizeof(text)) + "!");
+
+    std::memcpy(text, b.data(), b.size());
+    textLen = static_cast<int>(b.size());
     return;
 }
 
 
+/* MAPPEDFILE --------------------------------------------------------------- */
 
-/* MAPPING ------------------------------------------------------------------ */
-
-// constructor A and B
-MetaInfo::MetaInfo(){}
-MetaInfo::MetaInfo(string k, int kl, int vl, int vi, MetaInfo::SetterFunction ss)
+MappedFile::MappedFile(const std::string& filename) : ptr(nullptr), len(0)
 {
-    key = k;
-    keyLen = kl;
-    valLen = vl;
-    valIgn = vi;
-    setter = ss; // https://en.wikipedia.org/wiki/Command_pattern
-}
-
-// destructor: for now empty, as no files opened, etc.
-MetaInfo::~MetaInfo() {}
+    // open file read-only and query its size
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("unable to open file " + filename);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("unable to stat file " + filename);
+    }
+    len = static_cast<size_t>(st.st_size);
+
+    // NOTE: mmap rejects a length of 0, so empty files stay unmapped
+    if (len > 0) {
+        void* p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("unable to map file " + filename);
+        }
+        ptr = static_cast<const char*>(p);
+    }
 
-// standard getters
-const string MetaInfo::getKey() const { return key; }
-const int MetaInfo::getKeyLen() const { return keyLen; }
-const int MetaInfo::getValLen() const { return valLen; }
-const int MetaInfo::getLen() const { return (keyLen + valLen + valIgn); }
+    // the mapping stays valid after closing the descriptor
+    ::close(fd);
+}
 
-// special getter: associated setter function
-MetaInfo::SetterFunction MetaInfo::getSetter() { return setter; }
+MappedFile::~MappedFile()
+{
+    if (ptr)
+        ::munmap(const_cast<char*>(ptr), len);
+}
 
+const char* MappedFile::data() const { return ptr; }
+size_t MappedFile::size() const { return len; }
 
 
 /* -------------------------------------------------------------------------- */
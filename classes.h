@@ -1,14 +1,17 @@
 #pragma once
 
-#include <map>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
-using namespace std;
-
 
 /* HEADER ------------------------------------------------------------------- */
 
+// NOTE: all parsed fields are stored inline with their fixed width from the
+// format description, so parsing a header does not allocate. Text fields that
+// are shorter than their width (or not set) are padded with '\0'.
+
 class Header {
 private:
 
@@ -16,13 +19,13 @@ private:
     std::string filename;
 
     // product id ("Produktkennung")
-    std::string productId;
+    char productId[2];
 
     // file time stamp in YYMMDDhhmm format
-    std::string timestamp;
+    char timestamp[10];
 
     // "WMO-Nummer"
-    std::string wmo;
+    char wmo[5];
 
     // "Produktlänge in Byte"
     int by;
@@ -31,73 +34,83 @@ private:
     int vs;
 
     // "Software-Version"
-    std::string sw;
+    char sw[8];
 
     // "Genauigkeit der Daten"
-    std::string pr;
+    char pr[4];
 
     // "Intervalldauer in Minuten"
     int in;
 
     // "Anzahl der Pixel"
-    std::string gp;
+    char gp[9];
+
+    // rows and columns, as given by `gp`
+    int rows;
+    int cols;
     
     // "Vorhersagezeitpunkt"
     int vv;
 
     // "Modulflags"
-    std::string mf;
+    char mf[8];
 
     // Textlaenge m
     int ms;
 
-    // text "<...>""
-    std::string text;
+    // text "<...>"; m has 3 digits, hence the text has at most 999 bytes
+    char text[999];
+    int textLen;
 
 
 public:
     Header();                 // constructor
     ~Header();                // destructor
+    void clear();             // reset all fields but the file name
 
     // to string
     friend std::ostream& operator<<(std::ostream& os, const Header& h);
 
-    const std::string getFN() const;
-    const std::string getPI() const;
-    const std::string getTS() const;
-    const std::string getWN() const;
+    // NOTE: views are valid as long as the Header instance is
+    std::string_view getFN() const;
+    std::string_view getPI() const;
+    std::string_view getTS() const;
+    std::string_view getWN() const;
     
     const int getBY() const;
     const int getVS() const;
-    const std::string getSW() const;
-    const std::string getPR() const;
+    std::string_view getSW() const;
+    std::string_view getPR() const;
     const int getIN() const;
-    const std::string getGP() const;
+    std::string_view getGP() const;
+    const int getRows() const;
+    const int getCols() const;
+    const float getFactor() const;
     const int getVV() const;
-    const std::string getMF() const;
+    std::string_view getMF() const;
     const int getMS() const;
-    const std::string getText() const;
+    std::string_view getText() const;
 
 
     void setFN(std::string s);
-    void setPI(std::vector<char> b);
-    void setTS(char ts[]);
-    void setWN(std::vector<char> b);
+    void setPI(std::string_view b);
+    void setTS(std::string_view ts);
+    void setWN(std::string_view b);
     
-    void setBY(std::vector<char> b);
-    void setVS(std::vector<char> b);
-    void setSW(std::vector<char> b);
-    void setPR(std::vector<char> b);
-    void setIN(std::vector<char> b);
-    void setGP(std::vector<char> b);
-    void setVV(std::vector<char> b);
-    void setMF(std::vector<char> b);
-    void setMS(std::vector<char> b);
-    void setText(std::string);
+    void setBY(std::string_view b);
+    void setVS(std::string_view b);
+    void setSW(std::string_view b);
+    void setPR(std::string_view b);
+    void setIN(std::string_view b);
+    void setGP(std::string_view b);
+    void setVV(std::string_view b);
+    void setMF(std::string_view b);
+    void setMS(std::string_view b);
+    void setText(std::string_view b);
 
 
     // helpers
-    int evalBufferSize(std::vector<char> b, int n);
+    int evalBufferSize(std::string_view b, size_t n);
 
 };
 
@@ -110,12 +123,13 @@ class MetaInfo {
 
 public:
     // typedef for a member function pointer
-    using SetterFunction = void (Header::*)(std::vector<char>);  
+    using SetterFunction = void (Header::*)(std::string_view);  
 
 
 private:
-    // the key ("Kennung") is at most 3 chars long
-    string key;
+    // the key ("Kennung") is at most 3 chars long; only the first 2 chars
+    // identify the field (e.g. "IN" for "INT")
+    char key[2];
 
     // number of bytes per field
     int keyLen;
@@ -129,16 +143,45 @@ private:
 
 
 public:
-    MetaInfo();
-    MetaInfo(string, int, int, int, SetterFunction);
-    ~MetaInfo();
+    // NOTE: constexpr → instances can live in compile-time tables (see utils.h)
+    constexpr MetaInfo() : key{0, 0}, keyLen(0), valLen(0), valIgn(0), setter(nullptr) {}
+    constexpr MetaInfo(const char (&k)[3], int kl, int vl, int vi, SetterFunction ss)
+        : key{k[0], k[1]}, keyLen(kl), valLen(vl), valIgn(vi), setter(ss) {} 
+
+    constexpr std::string_view getKey() const { return std::string_view(key, 2); }
+    constexpr int getKeyLen() const { return keyLen; }
+    constexpr int getValLen() const { return valLen; }
+    constexpr int getValIgn() const { return valIgn; }
+    constexpr int getLen() const { return (keyLen + valLen + valIgn); }
+
+    // special getter: associated setter function
+    constexpr SetterFunction getSetter() const { return setter; }
+};
+
+
+/* MAPPEDFILE --------------------------------------------------------------- */
+
+// read-only memory mapping of a whole file; the mapping is released again by
+// the destructor, so views into data() must not outlive the instance (RAII)
+
+class MappedFile {
+private:
+    // start of the mapping (nullptr for empty files)
+    const char* ptr;
+
+    // number of mapped bytes, i.e. the file size
+    size_t len;
+
+public:
+    MappedFile(const std::string& filename);
+    ~MappedFile();
 
-    const string getKey() const;
-    const int getKeyLen() const;
-    const int getValLen() const;
-    const int getLen() const;
+    // a mapping is owned by exactly one instance: prevent copy and assignment
+    MappedFile(const MappedFile&) = delete;
+    void operator=(const MappedFile&) = delete;
 
-    SetterFunction getSetter();
+    const char* data() const;
+    size_t size() const;
 };
 
 
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "classes.h"
+#include "cube.h"
+#include "logger.h"
+#include "payload.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* LAYOUT ------------------------------------------------------------------- */
+
+Layout parseLayout(std::string_view s)
+{
+    if (s == "step")
+        return Layout::STEP_MAJOR;
+    if (s == "pixel")
+        return Layout::PIXEL_MAJOR;
+    throw std::invalid_argument("parseLayout: unknown layout '" + std::string(s) + "'!");
+}
+
+
+/* CUBE --------------------------------------------------------------------- */
+
+// constructor A
+Cube::Cube() : layout(Layout::STEP_MAJOR), steps(0), rows(0), cols(0), loadTime(0) {}
+
+// destructor: for now empty, as vectors clean up after themselves
+Cube::~Cube() {}
+
+const Layout Cube::getLayout() const { return layout; }
+const int Cube::getSteps() const { return steps; }
+const int Cube::getRows() const { return rows; }
+const int Cube::getCols() const { return cols; }
+const std::vector<Header>& Cube::getHeaders() const { return headers; }
+std::string_view Cube::getPI() const { return headers.empty() ? std::string_view() : headers[0].getPI(); }
+std::string_view Cube::getTS() const { return headers.empty() ? std::string_view() : headers[0].getTS(); }
+
+size_t Cube::index(int step, int row, int col) const
+{
+    size_t pixel = size_t(row) * cols + col;
+
+    if (layout == Layout::STEP_MAJOR)
+        return size_t(step) * rows * cols + pixel;
+    return pixel * steps + step;
+}
+
+const float* Cube::getValues() const { return values.data(); }
+const uint8_t* Cube::getMask() const { return mask.data(); }
+const size_t Cube::getBytes() const { return values.size() * sizeof(float) + mask.size(); }
+const double Cube::getLoadTime() const { return loadTime; }
+
+
+/* LOADING ------------------------------------------------------------------ */
+
+std::vector<std::vector<Result>> groupRuns(const std::vector<Result>& results)
+{
+    // results are sorted by PI and TS, hence each run is a contiguous range;
+    // products of the same TS are separate runs
+    std::vector<std::vector<Result>> runs;
+
+    for (const Result& r : results)
+    {
+        if (!r.error.empty())
+            continue;
+
+        if (runs.empty() || runs.back().back().header.getPI() != r.header.getPI() || runs.back().back().header.getTS() != r.header.getTS())
+            runs.emplace_back();
+
+        runs.back().push_back(r);
+    }
+    return runs;
+}
+
+
+// pixels per tile of a pixel-major transpose: a tile of all steps (25 for RV)
+// stays in L1, hence its strided reads do not miss
+const size_t TILE = 128;
+
+// pixels per task of `parallelFor`
+const size_t BLOCK = 16 * TILE;
+
+template <class T>
+static void interleave(const T* in, size_t stride, T* out, size_t steps, size_t n)
+{
+    // out[p * steps + s] = in[s * stride + p] for n pixels of one tile; the
+    // writes are sequential
+    for (size_t p = 0; p < n; p++)
+        for (size_t s = 0; s < steps; s++)
+            out[p * steps + s] = in[s * stride + p];
+}
+
+
+template <class T>
+static void transpose(const std::vector<T>& in, std::vector<T>& out, size_t steps, size_t pixels, unsigned jobs)
+{
+    // [step][pixel] → [pixel][step], one tile of TILE pixels x all steps at a
+    // time: every step contributes one short sequential read per tile, and
+    // the tile is written in one contiguous range
+    size_t blocks = (pixels + BLOCK - 1) / BLOCK;
+
+    parallelFor(blocks, jobs, [&](size_t b) {
+        size_t p1 = std::min(pixels, (b+1) * BLOCK);
+        for (size_t p = b * BLOCK; p < p1; p += TILE)
+            interleave(in.data() + p, pixels, out.data() + p * steps, steps, std::min(TILE, p1 - p));
+    });
+}
+
+
+void Cube::toPixelMajor(unsigned jobs)
+{
+    size_t pixels = size_t(rows) * cols;
+
+    std::vector<float> v(values.size());
+    std::vector<uint8_t> m(mask.size());
+
+    transpose(values, v, steps, pixels, jobs);
+    transpose(mask, m, steps, pixels, jobs);
+
+    values.swap(v);
+    mask.swap(m);
+    layout = Layout::PIXEL_MAJOR;
+}
+
+
+Cube loadCube(const std::vector<Result>& run, Layout layout, unsigned jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (run.empty())
+        throw std::invalid_argument("loadCube: run must contain at least one step!");
+
+    Cube c;
+    c.layout = layout;
+    c.steps = static_cast<int>(run.size());
+    c.rows = run[0].header.getRows();
+    c.cols = run[0].header.getCols();
+
+    // all steps must share PI, TS and grid, and each VV may occur only once
+    for (size_t s = 0; s < run.size(); s++)
+    {
+        const Header& h = run[s].header;
+
+        if (h.getPI() != run[0].header.getPI() || h.getTS() != run[0].header.getTS() || h.getRows() != c.rows || h.getCols() != c.cols)
+            throw std::invalid_argument("loadCube: " + std::string(h.getFN()) + " does not match run " + std::string(run[0].header.getTS()) + "!");
+        if (s > 0 && h.getVV() == run[s-1].header.getVV())
+            throw std::invalid_argument("loadCube: VV " + std::to_string(h.getVV()) + " occurs twice in run " + std::string(h.getTS()) + "!");
+
+        c.headers.push_back(h);
+    }
+
+    std::string_view pi = run[0].header.getPI();
+    size_t pixels = size_t(c.rows) * c.cols;
+    size_t bpp = bytesPerPixel(pi);
+    c.values.resize(pixels * c.steps);
+    c.mask.resize(pixels * c.steps);
+
+    // map every step once and check that its payload is complete
+    std::vector<std::unique_ptr<MappedFile>> files(run.size());
+    std::vector<const char*> payloads(run.size());
+    std::vector<float> factors(run.size());
+
+    parallelFor(run.size(), jobs, [&](size_t s) {
+        const Header& h = run[s].header;
+        files[s] = std::make_unique<MappedFile>(std::string(h.getFN()));
+
+        long etxIndex = findETX(files[s]->data(), files[s]->size());
+        if (etxIndex < 0 || files[s]->size() < size_t(etxIndex) + 1 + payloadBytes(h))
+            throw std::invalid_argument("loadCube: payload of " + std::string(h.getFN()) + " is incomplete!");
+
+        payloads[s] = files[s]->data() + etxIndex + 1;
+        factors[s] = h.getFactor();
+    });
+
+    if (layout == Layout::STEP_MAJOR)
+    {
+        // decode every step straight into its slice of the cube
+        parallelFor(run.size(), jobs, [&](size_t s) {
+            decodeProduct(pi, payloads[s], pixels, factors[s], c.values.data() + s * pixels, c.mask.data() + s * pixels);
+        });
+    }
+    else
+    {
+        // decode one tile of all steps into a small step-major buffer, then
+        // interleave it into the cube; no step-major copy of the whole run
+        size_t steps = run.size();
+        size_t blocks = (pixels + BLOCK - 1) / BLOCK;
+
+        parallelFor(blocks, jobs, [&](size_t b) {
+            std::vector<float> v(TILE * steps);
+            std::vector<uint8_t> m(TILE * steps);
+
+            size_t p1 = std::min(pixels, (b+1) * BLOCK);
+            for (size_t p = b * BLOCK; p < p1; p += TILE)
+            {
+                size_t n = std::min(TILE, p1 - p);
+                for (size_t s = 0; s < steps; s++)
+                    decodeProduct(pi, payloads[s] + bpp * p, n, factors[s], v.data() + s * TILE, m.data() + s * TILE);
+
+                interleave(v.data(), TILE, c.values.data() + p * steps, steps, n);
+                interleave(m.data(), TILE, c.mask.data() + p * steps, steps, n);
+            }
+        });
+    }
+
+    c.loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_INFO("loadCube: run " << c.getTS() << " with " << c.steps << " steps in " << c.loadTime << "s (" << c.getBytes() / 1e6 << " MB)");
+
+    return c;
+}
+
+
+size_t residentBytes()
+{
+#ifdef __linux__
+    // current resident pages, second field of /proc/self/statm
+    long pages = 0, resident = 0;
+    if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        std::fclose(f);
+    }
+    return size_t(resident) * sysconf(_SC_PAGESIZE);
+#else
+    // peak resident set size; NOTE: bytes on macOS
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+    return size_t(ru.ru_maxrss);
+#endif
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.h"
+#include "classes.h"
+
+
+/* LAYOUT ------------------------------------------------------------------- */
+
+// memory order of a cube
+//  STEP_MAJOR   [step][y][x]: each forecast step is one contiguous grid
+//  PIXEL_MAJOR  [y][x][step]: the time series of each pixel is contiguous
+
+enum class Layout { STEP_MAJOR, PIXEL_MAJOR };
+
+// "step" or "pixel"; throws std::invalid_argument otherwise
+Layout parseLayout(std::string_view s);
+
+
+/* CUBE --------------------------------------------------------------------- */
+
+// all forecast steps (VV) of one run (TS) decoded into one contiguous array
+
+class Cube {
+private:
+    Layout layout;
+
+    int steps;
+    int rows;
+    int cols;
+
+    // headers of all steps, ordered by VV
+    std::vector<Header> headers;
+
+    // precipitation values and FLAG_* bits, see `Layout`
+    std::vector<float> values;
+    std::vector<uint8_t> mask;
+
+    // wall time of `loadCube` in seconds
+    double loadTime;
+
+    // reorder step-major values and mask to PIXEL_MAJOR
+    void toPixelMajor(unsigned jobs);
+
+    friend Cube loadCube(const std::vector<Result>& run, Layout layout, unsigned jobs);
+    friend Cube loadCache(const std::string& path, Layout layout, unsigned jobs);
+
+public:
+    Cube();
+    ~Cube();
+
+    const Layout getLayout() const;
+    const int getSteps() const;
+    const int getRows() const;
+    const int getCols() const;
+    const std::vector<Header>& getHeaders() const;
+    std::string_view getPI() const;
+    std::string_view getTS() const;
+
+    // element index of (step, row, col) for this cube's layout
+    size_t index(int step, int row, int col) const;
+
+    const float* getValues() const;
+    const uint8_t* getMask() const;
+
+    // bytes held by values and mask
+    const size_t getBytes() const;
+    const double getLoadTime() const;
+};
+
+
+/* LOADING ------------------------------------------------------------------ */
+
+// split parsed headers (sorted by PI, TS and VV, see `processBatch`) into runs,
+// one per product and TS; failed results are skipped
+std::vector<std::vector<Result>> groupRuns(const std::vector<Result>& results);
+
+// decode all steps of one run of any product (see traits.h) on `jobs` worker
+// threads (0: one per core);
+// PIXEL_MAJOR is decoded tile by tile, without a step-major intermediate
+Cube loadCube(const std::vector<Result>& run, Layout layout, unsigned jobs);
+
+// resident set size of this process in bytes (0 if unknown)
+size_t residentBytes();
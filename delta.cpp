@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "classes.h"
+#include "delta.h"
+#include "logger.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* VALID TIME --------------------------------------------------------------- */
+
+static int digits(std::string_view s, size_t i)
+{
+    if (s[i] < '0' || s[i] > '9' || s[i+1] < '0' || s[i+1] > '9')
+        throw std::invalid_argument("validTime: TS '" + std::string(s) + "' is not numeric!");
+    return (s[i] - '0') * 10 + (s[i+1] - '0');
+}
+
+static long long daysFromCivil(int y, int m, int d)
+{
+    // days since 1970-01-01 in the proleptic Gregorian calendar (H. Hinnant)
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (long long)era * 146097 + doe - 719468;
+}
+
+long long validTime(const Header& h)
+{
+    std::string_view ts = h.getTS();
+    if (ts.size() < 10)
+        throw std::invalid_argument("validTime: TS '" + std::string(ts) + "' is too short!");
+
+    // yyMMddhhmm; RV products exist since 2020, hence yy is 20yy
+    int year = 2000 + digits(ts, 0);
+    int month = digits(ts, 2);
+    int day = digits(ts, 4);
+    int hour = digits(ts, 6);
+    int minute = digits(ts, 8);
+
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59)
+        throw std::invalid_argument("validTime: TS '" + std::string(ts) + "' is not a time stamp!");
+
+    return (daysFromCivil(year, month, day) * 24 + hour) * 60 + minute + h.getVV();
+}
+
+
+std::vector<std::pair<Result, Result>> alignRuns(const std::vector<std::vector<Result>>& runs)
+{
+    std::vector<std::pair<Result, Result>> pairs;
+
+    for (size_t i = 1; i < runs.size(); i++)
+    {
+        // runs of different products are not deltas of each other
+        if (runs[i].empty() || runs[i-1].empty() || runs[i][0].header.getPI() != runs[i-1][0].header.getPI())
+            continue;
+
+        // a run has a few dozen steps at most: a linear search is enough
+        for (const Result& target : runs[i])
+        {
+            long long t = validTime(target.header);
+
+            for (const Result& base : runs[i-1]) {
+                if (validTime(base.header) == t) {
+                    pairs.emplace_back(base, target);
+                    break;
+                }
+            }
+        }
+    }
+    return pairs;
+}
+
+
+/* ENCODING ----------------------------------------------------------------- */
+
+// payload of the mapped file of r, i.e. the `rows * cols` words after ETX; the
+// file must end right after them, as `applyDelta` and `checkFile` require
+static const char* payloadOf(const MappedFile& f, const Result& r, size_t pixels)
+{
+    long etxIndex = r.etxIndex >= 0 ? r.etxIndex : findETX(f.data(), f.size());
+
+    if (etxIndex < 0 || f.size() != size_t(etxIndex) + 1 + pixels * 2)
+        throw std::invalid_argument("encodeDelta: payload of " + std::string(r.header.getFN()) + " must be of size " + std::to_string(pixels * 2) + "!");
+    return f.data() + etxIndex + 1;
+}
+
+// index of the first word at or after i in which a and b differ (n if none)
+static size_t nextChange(const char* a, const char* b, size_t i, size_t n)
+{
+    // 4 words per comparison while the grids agree, which is most of them
+    for (; i + 4 <= n; i += 4) {
+        uint64_t x, y;
+        std::memcpy(&x, a + 2 * i, 8);
+        std::memcpy(&y, b + 2 * i, 8);
+        if (x != y)
+            break;
+    }
+    for (; i < n; i++)
+        if (std::memcmp(a + 2 * i, b + 2 * i, 2) != 0)
+            return i;
+    return n;
+}
+
+std::vector<char> encodeDelta(const Result& base, const Result& target)
+{
+    const Header& bh = base.header;
+    const Header& th = target.header;
+
+    if (bh.getRows() != th.getRows() || bh.getCols() != th.getCols())
+        throw std::invalid_argument("encodeDelta: grids of " + std::string(bh.getFN()) + " and " + std::string(th.getFN()) + " differ!");
+    if (bytesPerPixel(th.getPI()) != 2 || bh.getPI() != th.getPI())
+        throw std::invalid_argument("encodeDelta: " + std::string(th.getFN()) + " is not a product of pixel words like its base!");
+
+    const size_t pixels = size_t(th.getRows()) * th.getCols();
+
+    MappedFile bf(std::string(bh.getFN()));
+    MappedFile tf(std::string(th.getFN()));
+
+    const char* a = payloadOf(bf, base, pixels);
+    const char* b = payloadOf(tf, target, pixels);
+    const size_t headerLen = size_t(b - tf.data());
+
+    DeltaHeader dh = {};
+    std::memcpy(dh.magic, "PRVD", 4);
+    dh.version = DELTA_VERSION;
+    dh.rows = static_cast<uint32_t>(th.getRows());
+    dh.cols = static_cast<uint32_t>(th.getCols());
+    dh.headerLen = static_cast<uint32_t>(headerLen);
+    dh.baseHash = hashBytes(a, pixels * 2);
+    dh.targetHash = hashBytes(b, pixels * 2);
+
+    std::vector<char> d(sizeof(dh));
+    d.insert(d.end(), tf.data(), tf.data() + headerLen);
+
+    auto put = [&](uint32_t v) { d.insert(d.end(), reinterpret_cast<const char*>(&v), reinterpret_cast<const char*>(&v) + 4); };
+
+    size_t end = 0; // of the previous segment
+    for (size_t i = nextChange(a, b, 0, pixels); i < pixels; )
+    {
+        // extend the segment over gaps of less than DELTA_GAP equal words
+        size_t j = i + 1;
+        for (;;) {
+            size_t limit = std::min(pixels, j + DELTA_GAP);
+            size_t k = nextChange(a, b, j, limit);
+            if (k == limit)
+                break;
+            j = k + 1;
+        }
+
+        put(static_cast<uint32_t>(i - end));
+        put(static_cast<uint32_t>(j - i));
+        d.insert(d.end(), b + 2 * i, b + 2 * j);
+
+        for (size_t k = i; k < j; k++)
+            dh.changed += std::memcmp(a + 2 * k, b + 2 * k, 2) != 0;
+        dh.segments++;
+
+        end = j;
+        i = nextChange(a, b, j, pixels);
+    }
+
+    std::memcpy(d.data(), &dh, sizeof(dh));
+
+    LOG_DEBUG("encodeDelta: " << bh.getFN() << " → " << th.getFN() << ": " << dh.changed << " changed words in " << dh.segments << " segments");
+
+    return d;
+}
+
+
+/* DECODING ----------------------------------------------------------------- */
+
+void applyDelta(std::vector<char>& file, const char* d, size_t n)
+{
+    DeltaHeader dh;
+    if (n < sizeof(dh))
+        throw std::invalid_argument("applyDelta: delta is too small!");
+    std::memcpy(&dh, d, sizeof(dh));
+
+    if (std::memcmp(dh.magic, "PRVD", 4) != 0 || dh.version != DELTA_VERSION)
+        throw std::invalid_argument("applyDelta: not a delta of version " + std::to_string(DELTA_VERSION) + "!");
+    if (n < sizeof(dh) + dh.headerLen || dh.headerLen == 0 || d[sizeof(dh) + dh.headerLen - 1] != 0x03)
+        throw std::invalid_argument("applyDelta: header of the target is malformed!");
+
+    const size_t pixels = size_t(dh.rows) * dh.cols;
+
+    long etxIndex = findETX(file.data(), std::min(file.size(), HEADER_MAX));
+    if (etxIndex < 0 || file.size() != size_t(etxIndex) + 1 + pixels * 2)
+        throw std::invalid_argument("applyDelta: base is not a " + std::to_string(dh.rows) + "x" + std::to_string(dh.cols) + " RV file!");
+    if (hashBytes(file.data() + etxIndex + 1, pixels * 2) != dh.baseHash)
+        throw std::invalid_argument("applyDelta: delta belongs to another base!");
+
+    // swap the header in place: the payload only moves if the length differs
+    file.erase(file.begin(), file.begin() + etxIndex + 1);
+    file.insert(file.begin(), d + sizeof(dh), d + sizeof(dh) + dh.headerLen);
+
+    char* payload = file.data() + dh.headerLen;
+    const char* p = d + sizeof(dh) + dh.headerLen;
+    const char* const last = d + n;
+    size_t i = 0;
+
+    for (uint32_t s = 0; s < dh.segments; s++)
+    {
+        uint32_t skip, count;
+        if (last - p < 8)
+            throw std::invalid_argument("applyDelta: delta is truncated!");
+        std::memcpy(&skip, p, 4);
+        std::memcpy(&count, p + 4, 4);
+        p += 8;
+
+        i += skip;
+        if (i + count > pixels || size_t(last - p) < size_t(count) * 2)
+            throw std::invalid_argument("applyDelta: segment " + std::to_string(s) + " exceeds the grid!");
+
+        std::memcpy(payload + 2 * i, p, size_t(count) * 2);
+        p += size_t(count) * 2;
+        i += count;
+    }
+
+    if (hashBytes(payload, pixels * 2) != dh.targetHash)
+        throw std::invalid_argument("applyDelta: result does not match the target!");
+}
+
+
+/* FILES -------------------------------------------------------------------- */
+
+DeltaHeader writeDelta(const Result& base, const Result& target, const std::string& path)
+{
+    std::vector<char> d = encodeDelta(base, target);
+
+    // write to a temporary file and rename it, so readers never see half a delta
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("writeDelta: unable to create " + tmp);
+
+        out.write(d.data(), d.size());
+        if (!out)
+            throw std::runtime_error("writeDelta: unable to write " + tmp);
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("writeDelta: unable to rename " + tmp + " to " + path);
+    }
+
+    DeltaHeader dh;
+    std::memcpy(&dh, d.data(), sizeof(dh));
+
+    LOG_INFO("writeDelta: " << base.header.getFN() << " → " << target.header.getFN() << " to " << path << " (" << d.size() << " bytes)");
+
+    return dh;
+}
+
+
+std::vector<char> reconstruct(const std::string& base, const std::vector<std::string>& deltas)
+{
+    std::vector<char> file;
+    {
+        MappedFile f(base);
+        file.assign(f.data(), f.data() + f.size());
+    }
+
+    for (const std::string& path : deltas) {
+        MappedFile d(path);
+        try {
+            applyDelta(file, d.data(), d.size());
+        }
+        catch (const std::invalid_argument& e) {
+            throw std::invalid_argument(path + ": " + e.what());
+        }
+    }
+
+    LOG_INFO("reconstruct: " << base << " with " << deltas.size() << " deltas (" << file.size() << " bytes)");
+
+    return file;
+}
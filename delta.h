@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "classes.h"
+
+
+/* VALID TIME --------------------------------------------------------------- */
+
+// minutes since 1970-01-01 00:00 UTC at which a step is valid, i.e. TS (UTC,
+// `yyMMddhhmm`) plus VV; throws std::invalid_argument for a malformed TS
+long long validTime(const Header& h);
+
+// Steps of successive runs that are valid at the same time: for every step of
+// runs[i], i > 0, the step of runs[i-1] with the same valid time, as (base,
+// target) pairs. Runs are expected in PI and TS order, see `groupRuns`; runs
+// of different products are not paired.
+std::vector<std::pair<Result, Result>> alignRuns(const std::vector<std::vector<Result>>& runs);
+
+
+/* DELTAS ------------------------------------------------------------------- */
+
+// A delta turns one RV file (the base) into another on the same grid (the
+// target) by the pixel words that differ. File layout (.prvd, little-endian):
+//
+//  DeltaHeader
+//  headerLen bytes: the target's ASCII header, including the ETX byte
+//  `segments` times: uint32 skip, uint32 count, count raw pixel words
+//
+// where `skip` is the number of unchanged words since the end of the previous
+// segment. Changes less than DELTA_GAP words apart share one segment, as a
+// segment header costs as much as four words.
+
+struct DeltaHeader {
+    char magic[4];          // "PRVD"
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t headerLen;
+    uint32_t segments;
+    uint32_t changed;       // pixel words that differ
+    uint32_t reserved;
+    uint64_t baseHash;      // `hashBytes` of the base's payload
+    uint64_t targetHash;    // `hashBytes` of the target's payload
+};
+
+static_assert(sizeof(DeltaHeader) == 48, "DeltaHeader: unexpected padding!");
+
+const uint32_t DELTA_VERSION = 1;
+const size_t DELTA_GAP = 4;
+
+// delta from the file of `base` to the file of `target` (both with etxIndex
+// set, see `processFile`); throws std::invalid_argument if their grids differ
+// or a payload is incomplete
+std::vector<char> encodeDelta(const Result& base, const Result& target);
+
+// apply the delta at d (n bytes) to the RV file in `file`, in place; throws
+// std::invalid_argument if the delta is malformed or belongs to another base
+void applyDelta(std::vector<char>& file, const char* d, size_t n);
+
+// encode and write to path (via a temporary file); returns the header of the delta
+DeltaHeader writeDelta(const Result& base, const Result& target, const std::string& path);
+
+// the RV file at the end of the chain base → deltas[0] → deltas[1] → ...
+std::vector<char> reconstruct(const std::string& base, const std::vector<std::string>& deltas);
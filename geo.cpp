@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "classes.h"
+#include "geo.h"
+#include "logger.h"
+
+using namespace std;
+
+
+/* PROJECTION --------------------------------------------------------------- */
+
+const double PI = 3.14159265358979323846;
+const double DEG = PI / 180.0;
+
+// reference meridian and latitude of true scale
+const double LON_0 = 10.0;
+const double LAT_TS = 60.0;
+
+GridDef gridDef(int rows, int cols)
+{
+    GridDef g;
+    g.rows = rows;
+    g.cols = cols;
+    g.res = 1.0;
+
+    // RADOLAN national grid (RW, RY, YW, ...): sphere
+    if (rows == 900 && cols == 900) {
+        g.a = g.b = 6370.04;
+        g.x0 = -523.4622;
+        g.y0 = -4658.645;
+        return g;
+    }
+
+    // DE1200 grid (RV, ...): WGS84, the upper left corner is at the false
+    // origin (543.19683521776402, 3622.5888619310018) km
+    if (rows == 1200 && cols == 1100) {
+        g.a = 6378.137;
+        g.b = 6356.7523142451802;
+        g.x0 = -543.19683521776402;
+        g.y0 = -3622.5888619310018 - 1200.0;
+        return g;
+    }
+
+    throw std::invalid_argument("gridDef: unknown grid " + std::to_string(rows) + "x" + std::to_string(cols) + "!");
+}
+
+// t(lat) of Snyder (15-9); tan(pi/4 - lat/2) on a sphere
+static double isometric(double phi, double e)
+{
+    double s = e * std::sin(phi);
+    return std::tan(PI / 4 - phi / 2) / std::pow((1 - s) / (1 + s), e / 2);
+}
+
+Projection::Projection(const GridDef& g) : e(std::sqrt(1.0 - (g.b * g.b) / (g.a * g.a)))
+{
+    double phi = LAT_TS * DEG;
+    double s = e * std::sin(phi);
+    k = g.a * std::cos(phi) / std::sqrt(1 - s * s) / isometric(phi, e);
+}
+
+void Projection::forward(double lat, double lon, double& x, double& y) const
+{
+    double rho = k * isometric(lat * DEG, e);
+    double l = (lon - LON_0) * DEG;
+    x = rho * std::sin(l);
+    y = -rho * std::cos(l);
+}
+
+void Projection::inverse(double x, double y, double& lat, double& lon) const
+{
+    // conformal latitude, then the series of Snyder (3-5) for the geodetic
+    // one (exact on a sphere, below 1e-9 degrees on WGS84)
+    double chi = PI / 2 - 2 * std::atan(std::hypot(x, y) / k);
+
+    double e2 = e * e, e4 = e2 * e2, e6 = e4 * e2, e8 = e4 * e4;
+    double phi = chi +
+        (e2 / 2 + 5 * e4 / 24 + e6 / 12 + 13 * e8 / 360) * std::sin(2 * chi) +
+        (7 * e4 / 48 + 29 * e6 / 240 + 811 * e8 / 11520) * std::sin(4 * chi) +
+        (7 * e6 / 120 + 81 * e8 / 1120) * std::sin(6 * chi) +
+        (4279 * e8 / 161280) * std::sin(8 * chi);
+
+    lat = phi / DEG;
+    lon = LON_0 + std::atan2(x, -y) / DEG;
+}
+
+
+/* COORDINATE TABLE --------------------------------------------------------- */
+
+// constructor A and B
+CoordTable::CoordTable() {}
+
+CoordTable::CoordTable(const GridDef& g, unsigned jobs) : grid(g)
+{
+    centres.resize(size_t(g.rows) * g.cols * 2);
+
+    Projection p(g);
+
+    parallelFor(size_t(g.rows), jobs, [&](size_t r) {
+        for (int c = 0; c < g.cols; c++) {
+            double la, lo;
+            p.inverse(g.x0 + (c + 0.5) * g.res, g.y0 + (r + 0.5) * g.res, la, lo);
+            centres[2 * (r * g.cols + c)] = float(la);
+            centres[2 * (r * g.cols + c) + 1] = float(lo);
+        }
+    });
+
+    // Buckets of 0.75 pixels on the ground at the south (widest) edge, so any
+    // point is less than a pixel from its bucket's centre and the pixel
+    // containing it is among the 3x3 around the bucket's pixel. The box has a
+    // margin of 2 pixels.
+    float latLo = 90.0f, latHi = -90.0f, lonLo = 180.0f, lonHi = -180.0f;
+    for (size_t i = 0; i < centres.size(); i += 2) {
+        latLo = std::min(latLo, centres[i]);
+        latHi = std::max(latHi, centres[i]);
+        lonLo = std::min(lonLo, centres[i+1]);
+        lonHi = std::max(lonHi, centres[i+1]);
+    }
+
+    const double kmPerDegree = g.a * DEG;
+    const double margin = 2 * g.res / kmPerDegree;
+
+    latMin = latLo - margin;
+    dLat = 0.75 * g.res / kmPerDegree;
+    dLon = dLat / std::cos(latMin * DEG);
+
+    const double lonMargin = margin / std::cos((latHi + margin) * DEG);
+    lonMin = lonLo - lonMargin;
+
+    bucketRows = int(std::ceil((latHi + margin - latMin) / dLat));
+    bucketCols = int(std::ceil((lonHi + lonMargin - lonMin) / dLon));
+
+    cosLat.resize(bucketRows);
+    buckets.resize(size_t(bucketRows) * bucketCols);
+
+    parallelFor(size_t(bucketRows), jobs, [&](size_t br) {
+        double la = latMin + (br + 0.5) * dLat;
+        cosLat[br] = float(std::cos(la * DEG));
+
+        for (int bc = 0; bc < bucketCols; bc++) {
+            double x, y;
+            p.forward(la, lonMin + (bc + 0.5) * dLon, x, y);
+            double fx = std::floor((x - g.x0) / g.res);
+            double fy = std::floor((y - g.y0) / g.res);
+
+            // more than a pixel away: no point in this bucket is on the grid
+            uint32_t& k = buckets[br * bucketCols + bc];
+            if (fx < -1 || fx > g.cols || fy < -1 || fy > g.rows)
+                k = COORD_NONE;
+            else
+                k = uint32_t(std::clamp(int(fy), 0, g.rows - 1)) * uint32_t(g.cols) + uint32_t(std::clamp(int(fx), 0, g.cols - 1));
+        }
+    });
+
+    LOG_INFO("CoordTable: " << g.rows << "x" << g.cols << " pixels, " << bucketRows << "x" << bucketCols << " buckets");
+}
+
+// destructor: for now empty, as vectors clean up after themselves
+CoordTable::~CoordTable() {}
+
+const GridDef& CoordTable::getGrid() const { return grid; }
+float CoordTable::getLat(int row, int col) const { return centres[2 * (size_t(row) * grid.cols + col)]; }
+float CoordTable::getLon(int row, int col) const { return centres[2 * (size_t(row) * grid.cols + col) + 1]; }
+size_t CoordTable::getBuckets() const { return buckets.size(); }
+
+// points per task of `locate`
+const size_t LOCATE_BLOCK = 4096;
+
+void CoordTable::locate(const float* lats, const float* lons, size_t n, int32_t* rows, int32_t* cols, unsigned jobs) const
+{
+    const Projection p(grid);
+
+    const float latLo = float(latMin), lonLo = float(lonMin);
+    const float latScale = float(1.0 / dLat), lonScale = float(1.0 / dLon);
+    const float bRows = float(bucketRows), bCols = float(bucketCols);
+    const uint32_t stride = uint32_t(bucketCols);
+    const int R = grid.rows, C = grid.cols;
+
+    parallelFor((n + LOCATE_BLOCK - 1) / LOCATE_BLOCK, jobs, [&](size_t b) {
+        const size_t begin = b * LOCATE_BLOCK;
+        const size_t m = std::min(n - begin, LOCATE_BLOCK);
+        const float* la = lats + begin;
+        const float* lo = lons + begin;
+
+        // pass 1: bucket of every point, without branches (vectorizes);
+        // NaN fails both comparisons
+        uint32_t slot[LOCATE_BLOCK];
+        for (size_t i = 0; i < m; i++) {
+            float fi = (la[i] - latLo) * latScale;
+            float fj = (lo[i] - lonLo) * lonScale;
+            bool inside = (fi >= 0.0f) & (fi < bRows) & (fj >= 0.0f) & (fj < bCols);
+            slot[i] = inside ? uint32_t(fi) * stride + uint32_t(fj) : COORD_NONE;
+        }
+
+        // pass 2: their pixels; independent loads, hence the cache misses overlap
+        uint32_t pixel[LOCATE_BLOCK];
+        for (size_t i = 0; i < m; i++)
+            pixel[i] = slot[i] == COORD_NONE ? COORD_NONE : buckets[slot[i]];
+
+        // pass 3: nearest centre among that pixel and its neighbours
+        const float* centre = centres.data();
+        for (size_t i = 0; i < m; i++) {
+            int32_t& row = rows[begin + i];
+            int32_t& col = cols[begin + i];
+            row = col = -1;
+
+            // the 3 rows of centres a few points ahead
+            if (i + 8 < m && pixel[i+8] != COORD_NONE) {
+                const size_t q = pixel[i+8];
+                __builtin_prefetch(centre + 2 * q);
+                if (q >= size_t(C))
+                    __builtin_prefetch(centre + 2 * (q - C));
+                if (q + C < size_t(R) * C)
+                    __builtin_prefetch(centre + 2 * (q + C));
+            }
+
+            if (pixel[i] == COORD_NONE)
+                continue;
+
+            const uint32_t k = pixel[i];
+            const int r = int(k / uint32_t(C)), c = int(k % uint32_t(C));
+            const float cl = cosLat[slot[i] / stride];
+
+            float best = std::numeric_limits<float>::max();
+            int br = r, bc = c;
+            for (int rr = std::max(r - 1, 0); rr <= std::min(r + 1, R - 1); rr++) {
+                for (int cc = std::max(c - 1, 0); cc <= std::min(c + 1, C - 1); cc++) {
+                    const float* q = centre + 2 * (size_t(rr) * C + cc);
+                    float dy = la[i] - q[0];
+                    float dx = (lo[i] - q[1]) * cl;
+                    float d = dx * dx + dy * dy;
+                    if (d < best) { best = d; br = rr; bc = cc; }
+                }
+            }
+
+            // on a border pixel, the point may as well be outside the grid
+            if (br == 0 || br == R - 1 || bc == 0 || bc == C - 1) {
+                double x, y;
+                p.forward(la[i], lo[i], x, y);
+                double fx = std::floor((x - grid.x0) / grid.res);
+                double fy = std::floor((y - grid.y0) / grid.res);
+                if (fx < 0 || fx >= C || fy < 0 || fy >= R)
+                    continue;
+                br = int(fy);
+                bc = int(fx);
+            }
+
+            row = br;
+            col = bc;
+        }
+    });
+}
+
+void CoordTable::save(const std::string& path) const
+{
+    CoordHeader ch = {};
+    std::memcpy(ch.magic, "PRVG", 4);
+    ch.version = COORD_VERSION;
+    ch.rows = uint32_t(grid.rows);
+    ch.cols = uint32_t(grid.cols);
+    ch.bucketRows = uint32_t(bucketRows);
+    ch.bucketCols = uint32_t(bucketCols);
+    ch.a = grid.a;
+    ch.b = grid.b;
+    ch.x0 = grid.x0;
+    ch.y0 = grid.y0;
+    ch.res = grid.res;
+    ch.latMin = latMin;
+    ch.lonMin = lonMin;
+    ch.dLat = dLat;
+    ch.dLon = dLon;
+
+    // write to a temporary file and rename it, so readers never see half a table
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("CoordTable: unable to create " + tmp);
+
+        out.write(reinterpret_cast<const char*>(&ch), sizeof(ch));
+        out.write(reinterpret_cast<const char*>(centres.data()), centres.size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(cosLat.data()), cosLat.size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(buckets.data()), buckets.size() * sizeof(uint32_t));
+
+        if (!out)
+            throw std::runtime_error("CoordTable: unable to write " + tmp);
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("CoordTable: unable to rename " + tmp + " to " + path);
+    }
+}
+
+CoordTable readCoordTable(const std::string& path, const GridDef& g)
+{
+    MappedFile f(path);
+
+    CoordHeader ch;
+    if (f.size() < sizeof(ch))
+        throw std::invalid_argument("readCoordTable: " + path + " is too small!");
+    std::memcpy(&ch, f.data(), sizeof(ch));
+
+    if (std::memcmp(ch.magic, "PRVG", 4) != 0 || ch.version != COORD_VERSION)
+        throw std::invalid_argument("readCoordTable: " + path + " is not a coordinate table of version " + std::to_string(COORD_VERSION) + "!");
+
+    if (ch.rows != uint32_t(g.rows) || ch.cols != uint32_t(g.cols) || ch.a != g.a || ch.b != g.b || ch.x0 != g.x0 || ch.y0 != g.y0 || ch.res != g.res)
+        throw std::invalid_argument("readCoordTable: " + path + " was built for another grid!");
+
+    const size_t n = size_t(ch.rows) * ch.cols;
+    const size_t nb = size_t(ch.bucketRows) * ch.bucketCols;
+    if (f.size() != sizeof(ch) + (2 * n + ch.bucketRows) * sizeof(float) + nb * sizeof(uint32_t))
+        throw std::invalid_argument("readCoordTable: " + path + " is truncated!");
+
+    CoordTable t;
+    t.grid = g;
+    t.latMin = ch.latMin;
+    t.lonMin = ch.lonMin;
+    t.dLat = ch.dLat;
+    t.dLon = ch.dLon;
+    t.bucketRows = int(ch.bucketRows);
+    t.bucketCols = int(ch.bucketCols);
+
+    const char* p = f.data() + sizeof(ch);
+    auto take = [&p](auto& v, size_t count) {
+        v.resize(count);
+        std::memcpy(v.data(), p, count * sizeof(v[0]));
+        p += count * sizeof(v[0]);
+    };
+    take(t.centres, 2 * n);
+    take(t.cosLat, ch.bucketRows);
+    take(t.buckets, nb);
+
+    // every bucket must point into the grid
+    for (uint32_t k : t.buckets)
+        if (k != COORD_NONE && k >= n)
+            throw std::invalid_argument("readCoordTable: " + path + " is malformed!");
+
+    return t;
+}
+
+CoordTable loadCoordTable(const std::string& dir, int rows, int cols, unsigned jobs, bool* built)
+{
+    GridDef g = gridDef(rows, cols);
+    std::string path = (std::filesystem::path(dir) / (std::to_string(rows) + "x" + std::to_string(cols) + ".prvg")).string();
+
+    if (built)
+        *built = false;
+
+    if (std::filesystem::exists(path)) {
+        try {
+            return readCoordTable(path, g);
+        }
+        catch (const std::exception& e) {
+            // e.g. an older version: build it again
+            LOG_WARN("loadCoordTable: " << e.what());
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    CoordTable t(g, jobs);
+    std::filesystem::create_directories(dir);
+    t.save(path);
+
+    [[maybe_unused]] double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("loadCoordTable: built " << path << " in " << s << "s");
+
+    if (built)
+        *built = true;
+    return t;
+}
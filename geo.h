@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/* PROJECTION --------------------------------------------------------------- */
+
+// Polar stereographic projection of the DWD composites: north pole at the
+// centre, true to scale at 60°N, 10°E pointing down (-y). Grids of the older
+// RADOLAN products use a sphere of radius 6370.04 km, the DE1200 grid (RV and
+// all other 1200x1100 products) uses the WGS84 ellipsoid.
+//
+// GP rows x cols is a grid of res x res km pixels with its lower left (south
+// west) corner at (x0, y0); payload row 0 is the southernmost row, i.e. pixel
+// (row, col) has its centre at (x0 + (col + 0.5) * res, y0 + (row + 0.5) * res).
+
+struct GridDef {
+    int rows = 0;
+    int cols = 0;
+    double a = 0.0;         // semi-major axis in km
+    double b = 0.0;         // semi-minor axis in km
+    double x0 = 0.0;        // lower left corner in km
+    double y0 = 0.0;
+    double res = 0.0;       // pixel size in km
+};
+
+// grid of GP rows x cols (900x900 or 1200x1100); throws std::invalid_argument
+// for other sizes
+GridDef gridDef(int rows, int cols);
+
+// forward and inverse projection of one grid, in degrees and km
+
+class Projection {
+private:
+    double e;               // eccentricity, 0 for a sphere
+    double k;               // scale such that rho = k * t(lat)
+
+public:
+    explicit Projection(const GridDef& g);
+
+    void forward(double lat, double lon, double& x, double& y) const;
+    void inverse(double x, double y, double& lat, double& lon) const;
+};
+
+
+/* COORDINATE TABLE --------------------------------------------------------- */
+
+// Latitude and longitude of every pixel centre of one grid, plus a uniform
+// bucket index for the inverse lookup: the bounding box of the grid in lat/lon
+// is cut into buckets of about 0.75 pixels, and each bucket holds the pixel
+// that contains its centre. A point is then mapped by one table load and a
+// comparison with the centres of that pixel and its 8 neighbours, without any
+// trigonometry; only points that land on a border pixel are projected exactly,
+// to tell inside from outside.
+//
+// File layout (.prvg, little-endian): CoordHeader, then float centres[rows *
+// cols * 2] (lat, lon pairs in payload order), float cosLat[bucketRows], uint32
+// buckets[bucketRows * bucketCols] (COORD_NONE for buckets away from the grid).
+
+struct CoordHeader {
+    char magic[4];          // "PRVG"
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t bucketRows;
+    uint32_t bucketCols;
+    double a;               // the GridDef the table was built for
+    double b;
+    double x0;
+    double y0;
+    double res;
+    double latMin;          // south west corner of bucket (0, 0)
+    double lonMin;
+    double dLat;            // bucket size in degrees
+    double dLon;
+};
+
+static_assert(sizeof(CoordHeader) == 96, "CoordHeader: unexpected padding!");
+
+const uint32_t COORD_VERSION = 1;
+const uint32_t COORD_NONE = UINT32_MAX;
+
+class CoordTable {
+private:
+    GridDef grid;
+
+    // pixel centres in payload order, lat and lon interleaved so that one
+    // cache line holds both for 8 neighbours
+    std::vector<float> centres;
+
+    // bucket index; cosLat scales longitude differences to distances per row
+    double latMin = 0.0;
+    double lonMin = 0.0;
+    double dLat = 0.0;
+    double dLon = 0.0;
+    int bucketRows = 0;
+    int bucketCols = 0;
+    std::vector<float> cosLat;
+    std::vector<uint32_t> buckets;
+
+    friend CoordTable readCoordTable(const std::string& path, const GridDef& g);
+
+public:
+    CoordTable();
+    ~CoordTable();
+
+    // build the table of g on `jobs` worker threads (0: one per core)
+    CoordTable(const GridDef& g, unsigned jobs);
+
+    const GridDef& getGrid() const;
+
+    // latitude and longitude of pixel (row, col) in degrees
+    float getLat(int row, int col) const;
+    float getLon(int row, int col) const;
+
+    size_t getBuckets() const;
+
+    // row and column of the pixel containing each of n points (degrees), or
+    // -1 for both where the point is outside the grid
+    void locate(const float* lats, const float* lons, size_t n, int32_t* rows, int32_t* cols, unsigned jobs) const;
+
+    // write to path (via a temporary file)
+    void save(const std::string& path) const;
+};
+
+// read a table written by `save`; throws std::invalid_argument if the file is
+// malformed or was built for another grid than g
+CoordTable readCoordTable(const std::string& path, const GridDef& g);
+
+// <dir>/<rows>x<cols>.prvg if it is valid, else build the table and save it
+// there; built tells which
+CoordTable loadCoordTable(const std::string& dir, int rows, int cols, unsigned jobs, bool* built = nullptr);
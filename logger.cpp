@@ -1,4 +1,15 @@
 #include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <log4cxx/logger.h>
 #include <log4cxx/basicconfigurator.h>
 
 #include <log4cxx/propertyconfigurator.h>
@@ -7,23 +18,15 @@
 #include <log4cxx/patternlayout.h>
 
 
-/* SINGLETON for logger → define STATIC MEMBER variable
+/* SINGLETON for logger → log4cxx instance
  *
- * This means that there is only 1 instance of this variable, shared across all
- * Logger class instances. 
- *  → its lifetime therefore must start at program start!
- * 
- * NOTE: may not assign a value (see below)!
+ * There is only 1 instance of this variable, shared across all threads. It is
+ * created on first use; function-local statics are initialized exactly once,
+ * even if several threads log at the same time (C++11).
  */
-log4cxx::LoggerPtr Logger::logger; 
-
-// NOTE: this does not work!
-// log4cxx::LoggerPtr LoggerWrapper::logger = log4cxx::Logger::getLogger("PRVH");
-
-log4cxx::LoggerPtr& Logger::get() {
+static log4cxx::LoggerPtr& instance() {
 
-    // check if variable is actually initialized
-    if (!logger) {
+    static log4cxx::LoggerPtr logger = []() {
 
         /* logging to console */
 
@@ -37,10 +40,7 @@ log4cxx::LoggerPtr& Logger::get() {
         /* logging to file */
 
         // initialize pointer to logger instance in static variable
-        logger = log4cxx::Logger::getLogger("PRVH");
-
-        // create file appender with SimpleLayout that appends to file
-        // log4cxx::AppenderPtr appender(new log4cxx::FileAppender(log4cxx::LayoutPtr(new log4cxx::SimpleLayout()), "logs.log", true));
+        log4cxx::LoggerPtr l = log4cxx::Logger::getLogger("PRVH");
 
         // define PatternLayout:
         // %d       timestamp
@@ -49,14 +49,201 @@ log4cxx::LoggerPtr& Logger::get() {
         // %m       log message
         // %n       new line
         log4cxx::LayoutPtr layout(new log4cxx::PatternLayout("%d [%t] %-5p %c - %m%n"));
-    
+
         // create file appender with PatternLayout that appends to file
         log4cxx::AppenderPtr appender(new log4cxx::FileAppender(layout, "logs.log", true));
 
         // attach appender to logger
-        logger->addAppender(appender);
-    }
+        l->addAppender(appender);
+
+        return l;
+    }();
 
     // return static pointer to logger instance
     return logger;
-}
\ No newline at end of file
+}
+
+static void forward(int level, const std::string& msg) {
+
+    // pass one record on to log4cxx (and thereby to the file appender)
+    log4cxx::LoggerPtr& l = instance();
+
+    switch (level) {
+        case PRVH_LEVEL_DEBUG: LOG4CXX_DEBUG(l, msg); break;
+        case PRVH_LEVEL_INFO:  LOG4CXX_INFO(l, msg); break;
+        case PRVH_LEVEL_WARN:  LOG4CXX_WARN(l, msg); break;
+        default:               LOG4CXX_ERROR(l, msg); break;
+    }
+}
+
+
+/* RING BUFFER for async mode
+ *
+ * Bounded multi-producer, single-consumer queue after D. Vyukov: every slot
+ * carries a sequence number that tells producers and the consumer whether the
+ * slot is free or filled, so neither side ever takes a lock.
+ */
+
+const size_t RING_SIZE = 4096; // must be a power of 2
+
+struct Slot {
+    std::atomic<size_t> seq;
+    int level;
+    size_t len;
+    char msg[LOG_RECORD_SIZE];
+};
+
+static Slot ring[RING_SIZE];
+static std::atomic<size_t> tail{0};   // next slot to fill (producers)
+static std::atomic<size_t> head{0};   // next slot to drain (consumer)
+
+static std::atomic<bool> async{false};
+static std::atomic<bool> running{false};
+static std::atomic<size_t> dropped{0};
+static std::thread drainer;
+static std::mutex control;            // guards starting/stopping `drainer`
+
+static bool push(int level, const char* msg, size_t n) {
+
+    size_t pos = tail.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Slot& s = ring[pos & (RING_SIZE-1)];
+        size_t seq = s.seq.load(std::memory_order_acquire);
+        long diff = static_cast<long>(seq) - static_cast<long>(pos);
+
+        // slot is free: try to claim it
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+                s.level = level;
+                s.len = std::min(n, LOG_RECORD_SIZE);
+                std::memcpy(s.msg, msg, s.len);
+
+                // publish the record to the consumer
+                s.seq.store(pos+1, std::memory_order_release);
+                return true;
+            }
+        }
+        // slot still holds an undrained record: ring is full
+        else if (diff < 0)
+            return false;
+
+        // another producer claimed the slot first: retry with its successor
+        else
+            pos = tail.load(std::memory_order_relaxed);
+    }
+}
+
+static bool pop() {
+
+    // drain one record, if any, and hand it to log4cxx
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot& s = ring[pos & (RING_SIZE-1)];
+    if (s.seq.load(std::memory_order_acquire) != pos+1)
+        return false;
+
+    forward(s.level, std::string(s.msg, s.len));
+
+    // release the slot for the producers of the next round
+    s.seq.store(pos + RING_SIZE, std::memory_order_release);
+    head.store(pos+1, std::memory_order_release);
+    return true;
+}
+
+static void drain() {
+
+    // background thread: drain until stopped, sleep briefly when idle
+    while (running.load(std::memory_order_acquire)) {
+        if (!pop())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // write what is left after producers stopped
+    while (pop()) {}
+
+    size_t n = dropped.exchange(0);
+    if (n > 0)
+        forward(PRVH_LEVEL_WARN, "Logger: dropped " + std::to_string(n) + " records (ring buffer full)");
+}
+
+static void stop() {
+
+    std::lock_guard<std::mutex> lock(control);
+    async.store(false);
+
+    if (drainer.joinable()) {
+        running.store(false, std::memory_order_release);
+        drainer.join();
+    }
+}
+
+
+/* LOGGER ------------------------------------------------------------------- */
+
+bool Logger::isEnabled(int level) {
+
+    log4cxx::LoggerPtr& l = instance();
+
+    switch (level) {
+        case PRVH_LEVEL_DEBUG: return l->isDebugEnabled();
+        case PRVH_LEVEL_INFO:  return l->isInfoEnabled();
+        case PRVH_LEVEL_WARN:  return l->isWarnEnabled();
+        default:               return l->isErrorEnabled();
+    }
+}
+
+void Logger::write(int level, const char* msg, size_t n) {
+
+    if (!async.load(std::memory_order_acquire)) {
+        forward(level, std::string(msg, n));
+        return;
+    }
+
+    // never block the caller: count records that do not fit
+    if (!push(level, msg, n))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::setAsync(bool on) {
+
+    if (!on) {
+        stop();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(control);
+    if (drainer.joinable())
+        return;
+
+    // initialize sequence numbers: each slot is free for the next position p
+    // that maps onto it, starting from the current tail
+    size_t t = tail.load();
+    for (size_t p = t; p < t + RING_SIZE; p++)
+        ring[p & (RING_SIZE-1)].seq.store(p, std::memory_order_relaxed);
+    head.store(t);
+
+    // make sure log4cxx is set up before the first record is drained
+    instance();
+
+    running.store(true, std::memory_order_release);
+    drainer = std::thread(drain);
+    async.store(true, std::memory_order_release);
+
+    // drain the remaining records on exit
+    static bool registered = false;
+    if (!registered) {
+        std::atexit(stop);
+        registered = true;
+    }
+}
+
+void Logger::flush() {
+
+    // wait until the consumer caught up with all records published so far
+    if (!async.load(std::memory_order_acquire))
+        return;
+
+    size_t target = tail.load(std::memory_order_acquire);
+    while (head.load(std::memory_order_acquire) < target && running.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
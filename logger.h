@@ -1,25 +1,122 @@
-#include <log4cxx/logger.h>
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+
+/* LEVELS */
+
+#define PRVH_LEVEL_DEBUG 0
+#define PRVH_LEVEL_INFO  1
+#define PRVH_LEVEL_WARN  2
+#define PRVH_LEVEL_ERROR 3
+#define PRVH_LEVEL_OFF   4
+
+// compile-time threshold, e.g. `-DPRVH_LOG_LEVEL=PRVH_LEVEL_ERROR`: statements
+// below it are removed by the preprocessor, so their arguments are never even
+// formatted (see the LOG_* macros below)
+#ifndef PRVH_LOG_LEVEL
+#define PRVH_LOG_LEVEL PRVH_LEVEL_INFO
+#endif
+
+// maximum length of one formatted record; longer messages are truncated
+const size_t LOG_RECORD_SIZE = 256;
+
 
 /* SINGLETON for logger */
 
+// NOTE: log4cxx is only included by logger.cpp, hence code that is built with
+// PRVH_LOG_LEVEL=PRVH_LEVEL_OFF does not depend on it at all
+
 class Logger {
 private:
 
-    // make constructor private due to singleton: prevent outside entities from 
+    // make constructor private due to singleton: prevent outside entities from
     // creation of new instances and ensure there is only 1 instance!!
     // C++11: "default" constructor: tells compiler to generate it automatically
-    Logger() = default; 
-
-    // static pointer to logger instance
-    static log4cxx::LoggerPtr logger;
+    Logger() = default;
 
 public:
 
-    // always return the same logger instance 
-    static log4cxx::LoggerPtr& get();
+    // runtime check against the level configured for the log4cxx logger
+    static bool isEnabled(int level);
+
+    // hand over one formatted record: written synchronously to the file
+    // appender, or queued for the background thread in async mode
+    static void write(int level, const char* msg, size_t n);
+
+    // async mode: records go into a lock-free ring buffer that a background
+    // thread drains; records are dropped (and counted) while the ring is full
+    static void setAsync(bool async);
+
+    // wait until all queued records are written
+    static void flush();
 
     // singleton: prevent copy and assignment
-    Logger(const Logger&) = delete; 
+    Logger(const Logger&) = delete;
     void operator=(const Logger&) = delete;
 
-};
\ No newline at end of file
+};
+
+
+/* RECORD FORMATTING */
+
+// stream buffer writing into a fixed array → formatting does not allocate
+
+class LogBuffer : public std::streambuf {
+private:
+    char buf[LOG_RECORD_SIZE];
+
+public:
+    LogBuffer() { setp(buf, buf + LOG_RECORD_SIZE); }
+
+    const char* data() const { return pbase(); }
+    size_t size() const { return static_cast<size_t>(pptr() - pbase()); }
+};
+
+class LogStream : public std::ostream {
+private:
+    LogBuffer buffer;
+
+public:
+    LogStream() : std::ostream(nullptr) { rdbuf(&buffer); }
+
+    const char* data() const { return buffer.data(); }
+    size_t size() const { return buffer.size(); }
+};
+
+
+/* MACROS */
+
+#define PRVH_LOG(level, message) \
+    do { \
+        if (Logger::isEnabled(level)) { \
+            LogStream s_; \
+            s_ << message; \
+            Logger::write(level, s_.data(), s_.size()); \
+        } \
+    } while (0)
+
+#if PRVH_LOG_LEVEL <= PRVH_LEVEL_DEBUG
+#define LOG_DEBUG(message) PRVH_LOG(PRVH_LEVEL_DEBUG, message)
+#else
+#define LOG_DEBUG(message) do {} while (0)
+#endif
+
+#if PRVH_LOG_LEVEL <= PRVH_LEVEL_INFO
+#define LOG_INFO(message) PRVH_LOG(PRVH_LEVEL_INFO, message)
+#else
+#define LOG_INFO(message) do {} while (0)
+#endif
+
+#if PRVH_LOG_LEVEL <= PRVH_LEVEL_WARN
+#define LOG_WARN(message) PRVH_LOG(PRVH_LEVEL_WARN, message)
+#else
+#define LOG_WARN(message) do {} while (0)
+#endif
+
+#if PRVH_LOG_LEVEL <= PRVH_LEVEL_ERROR
+#define LOG_ERROR(message) PRVH_LOG(PRVH_LEVEL_ERROR, message)
+#else
+#define LOG_ERROR(message) do {} while (0)
+#endif
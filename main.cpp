@@ -1,183 +1,975 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
+#include "batch.h"
+#include "cache.h"
+#include "check.h"
 #include "classes.h"
+#include "cube.h"
+#include "delta.h"
+#include "geo.h"
 #include "logger.h"
+#include "output.h"
+#include "payload.h"
+#include "products.h"
+#include "query.h"
+#include "scan.h"
+#include "serve.h"
+#include "sparse.h"
+#include "stats.h"
+#include "stream.h"
+#include "tiles.h"
 #include "utils.h"
+#include "watch.h"
+#include "zones.h"
 
 using namespace std;
 
-int main(int argc, char* argv[]) {
 
-    /* init Header instance ------------------------------------------------- */
+/* USAGE -------------------------------------------------------------------- */
+
+static void usage(const char* prog) {
+    std::cerr <<
+        "Usage: " << prog << " [options] <file|dir|@list|archive.tar[.bz2]|->...\n"
+        "       " << prog << " serve --socket <path> [--zones <file>] [options] <inputs>...\n"
+        "\n"
+        "  --decode              decode the payload and print a summary\n"
+        "  --check               check BY, GP and ETX against the file size only\n"
+        "  --format <f>          text (default), jsonl, csv or bin (see output.h)\n"
+        "  --cube                load each run into a forecast cube\n"
+        "  --layout step|pixel   cube layout [step][y][x] (default) or [y][x][step]\n"
+        "  --at <row,col>        print one pixel of every step of each run\n"
+        "  --window <r0,c0,r1,c1>  print a window (inclusive) of every step\n"
+        "  --sparse              decode into the sparse form and print its size\n"
+        "  --products            accumulation, max rate and exceedances of each run\n"
+        "  --thresholds <t,...>  rate thresholds in mm/h (default: 1,5,10)\n"
+        "  --zones <file>        sum, mean, max and coverage of each region (CSV)\n"
+        "  --tiles <dir>         write a tile pyramid of every step to dir\n"
+        "  --aggregate mean|max  pyramid aggregation (default: mean)\n"
+        "  --save-cache <dir>    write each run to <dir>/<PI><TS>.prvc\n"
+        "  --load-cache          inputs are .prvc files; load them as cubes\n"
+        "  --delta <dir>         write deltas between steps of successive runs\n"
+        "                        with the same valid time to dir\n"
+        "  --reconstruct <out>   inputs are a base file and .prvd deltas; write\n"
+        "                        the file at the end of the chain to out\n"
+        "  --coords <dir>        load or build the lat/lon table of each grid in dir\n"
+        "  --locate <file>       map `lat lon` lines of file to row,col (with --coords)\n"
+        "  --socket <path>       serve: Unix domain socket to listen on\n"
+        "  --watch <dir>         parse new files in dir as they arrive (until ^C)\n"
+        "  --io mmap|pread|uring how to read files (default: mmap)\n"
+        "  -j, --jobs <n>        worker threads (default: one per core)\n"
+        "  --async-log           log through a background thread\n"
+        "  --stats               print per-stage timings and counters to stderr\n"
+        "  --stats-file <path>   export them in Prometheus text format to path\n";
+}
+
 
-    Header h;
+/* ALLOCATION COUNTER ------------------------------------------------------- */
 
-    
-    /* init Mapping instance ------------------------------------------------ */
+// replace global operator new to count heap allocations for --stats; costs
+// one relaxed load while stats are off
 
-    // get key-value mapping for processing the ASCII header's structure
-    std::map<std::string, MetaInfo> metainfo = getMetaInfo();
+void* operator new(size_t n)
+{
+    Stats::add(Counter::ALLOCATIONS);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
 
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
 
-    /* handle file ---------------------------------------------------------- */
 
-    // documentation on opening files: https://cplusplus.com/doc/tutorial/files/
+/* HELPERS ------------------------------------------------------------------ */
 
-    // check if user provided a filename
-    if (argc < 2) {
-        LOG4CXX_ERROR(Logger::get(), "main: invalid program invocation!");
-        std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+static std::vector<int> parseInts(const std::string& s) {
 
-        // return with error
+    // split a comma-separated list of integers, e.g. `512,300`
+    std::vector<int> v;
+    std::stringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+        v.push_back(std::stoi(item));
+    return v;
+}
+
+static std::vector<float> parseFloats(const std::string& s) {
+
+    // split a comma-separated list of numbers, e.g. `0.1,1,10`
+    std::vector<float> v;
+    std::stringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+        v.push_back(std::stof(item));
+    return v;
+}
+
+static void printValue(std::ostream& os, const Grid& g, size_t k) {
+
+    // one pixel: value with 2 decimals, or "-" for no data
+    if (g.getMask()[k] & FLAG_NODATA)
+        os << std::setw(7) << "-";
+    else
+        os << std::setw(7) << std::fixed << std::setprecision(2) << g.getValues()[k];
+}
+
+
+/* MODES -------------------------------------------------------------------- */
+
+static bool printHeader(const Result& r, bool& first) {
+
+    if (!r.error.empty()) {
+        std::cerr << r.error << std::endl;
+        return false;
+    }
+
+    // separate headers by an empty line
+    if (!first)
+        cout << "\n";
+    first = false;
+
+    // print header to console
+    StageTimer output(Stage::OUTPUT);
+    cout << r.header << endl;
+
+    if (r.decoded)
+        cout << r.summary << endl;
+
+    return true;
+}
+
+static int printHeaders(const std::vector<Result>& results) {
+
+    int status = 0;
+    bool first = true;
+
+    for (const Result& r : results)
+        if (!printHeader(r, first))
+            status = 1; // exit with error
+
+    // status code 0 if all files were processed
+    return status;
+}
+
+static int writeRecords(const std::vector<Result>& results, Format format, bool decode) {
+
+    // machine-readable output, with the payload summary if decoded; errors
+    // still go to stderr
+    int status = 0;
+    Writer w(STDOUT_FILENO);
+    writeHead(w, format, decode);
+
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+            continue;
+        }
+        StageTimer output(Stage::OUTPUT);
+        writeRecord(w, r.header, format, r.decoded ? &r.summary : nullptr);
+    }
+
+    StageTimer output(Stage::OUTPUT);
+    w.flush();
+    return status;
+}
+
+static int watch(const std::string& dir, bool decode, Format format) {
+
+    // print every new or changed file as soon as it is parsed
+    bool first = true;
+    Writer w(STDOUT_FILENO);
+
+    try {
+        writeHead(w, format, decode);
+
+        watchDirectory(dir, decode, [&](const Result& r) {
+            if (format == Format::TEXT || !r.error.empty()) {
+                printHeader(r, first);
+                return;
+            }
+            writeRecord(w, r.header, format, r.decoded ? &r.summary : nullptr);
+            w.flush();
+        });
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("main: " << e.what());
+        std::cerr << e.what() << std::endl;
         return 1;
     }
+    return 0;
+}
+
 
-    // save file name to variable
-    string filename = argv[1];
+static void printCube(const Cube& c) {
+
+    cout <<
+        "Forecast cube of " << c.getPI() << " run '" << c.getTS() << "'\n" <<
+        " steps:  " << c.getSteps() << " (VV " << c.getHeaders().front().getVV() << " to " << c.getHeaders().back().getVV() << ")\n" <<
+        " grid:   " << c.getRows() << "x" << c.getCols() << "\n" <<
+        " layout: " << (c.getLayout() == Layout::STEP_MAJOR ? "[step][y][x]" : "[y][x][step]") << "\n" <<
+        " size:   " << c.getBytes() / 1e6 << " MB\n" <<
+        " load:   " << c.getLoadTime() * 1e3 << " ms\n" <<
+        " RSS:    " << residentBytes() / 1e6 << " MB" << endl;
+}
 
-    // set header attribute
-    h.setFN(filename);
+static int printCubes(const std::vector<Result>& results, Layout layout, unsigned jobs) {
 
-    // open file in binary mode and check for errors
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        LOG4CXX_ERROR(Logger::get(), "main: unable to open file " << filename);
-        std::cerr << "Could not open file " << filename << std::endl;
-        return 1; // exit with error
+    int status = 0;
+
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+        }
     }
 
-    LOG4CXX_INFO(Logger::get(), "main: opened file " << argv[1] << " successfully!");
+    bool first = true;
 
+    for (const std::vector<Result>& run : groupRuns(results)) {
 
-    /* import header -------------------------------------------------------- */
+        // separate cubes by an empty line
+        if (!first)
+            cout << "\n";
+        first = false;
 
-    // get ETX byte position
-    long etxIndex = findETX(file);
+        try {
+            printCube(loadCube(run, layout, jobs));
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
 
-    // EXAMPLE: yields 191 = '0x000000b0' = 176 + 7 + 8 = 191 :)
-    LOG4CXX_INFO(Logger::get(), "ETX index: " << etxIndex);
+    return status;
+}
 
-    // load header into local variable
-    std::vector<char> hb = getHeader(file, etxIndex);
 
+static int printProducts(const std::vector<Result>& results, const std::vector<float>& thresholds, unsigned jobs) {
 
-    // close file
-    file.close();
-    LOG4CXX_INFO(Logger::get(), "main: closed file");
+    int status = 0;
 
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+        }
+    }
 
-    /* handle fixed-positioned meta data ------------------------------------ */
-    
-    // "Produktkennung"
-    
-    // get bytes at position 1 and 2
-    std::vector<char> bytes(hb.begin(), hb.begin() + 2);
+    bool first = true;
 
-    // set header attribute
-    h.setPI(bytes);
+    for (const std::vector<Result>& run : groupRuns(results)) {
 
+        // separate runs by an empty line
+        if (!first)
+            cout << "\n";
+        first = false;
 
-    // time stamp 
-    // → read 3 "data fields" at once, then split and build time stamp
-    bytes.assign(
-        hb.begin()+2,           // begin reading after "Produktkennung"
-        hb.begin()+2+6+5+4);    // read 6 ts A + 5 WMO + 4 ts B bytes
+        try {
+            Cube c = loadCube(run, Layout::STEP_MAJOR, jobs);
+            Products p = reduceCube(c, thresholds, jobs);
 
+            Summary acc = summarize(p.accumulation);
+            Summary rate = summarize(p.maxRate);
 
-    // extract and create timestamp in "YYMMDDhhmm" format
-    char ts[11] = {
-        bytes[13], bytes[14], // YY
-        bytes[11], bytes[12], // MM
-        bytes[0], bytes[1],   // DD
-        bytes[2], bytes[3],   // hh
-        bytes[4], bytes[5],   // mm
-        '\0'};                // end c-string with null-terminator
-    
-    // set header attribute
-    h.setTS(ts);
-    
+            cout <<
+                "Products of " << c.getPI() << " run '" << c.getTS() << "' (" << c.getSteps() << " steps, " << reduceKernel() << ", " << p.reduceTime * 1e3 << " ms)\n" <<
+                " accumulation: " << acc.wet << " wet pixels, max " << acc.max << " mm\n" <<
+                " max rate:     max " << rate.max << " mm/h\n";
 
-    // "WMO Nummer"
+            for (size_t t = 0; t < thresholds.size(); t++) {
+                Summary e = summarize(p.exceedances[t]);
+                cout << " > " << thresholds[t] << " mm/h: " << e.wet << " pixels, up to " << e.max << " steps\n";
+            }
+            cout << std::flush;
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
 
-    // extract "WMO-Nummer": offset is 6B from ts A, length is 5B
-    bytes.assign(hb.begin()+8, hb.begin()+8+5);
+static int printSparse(const std::vector<Result>& results) {
 
-    // set header attribute
-    h.setWN(bytes);
-    
+    // one line per file: stored entries, no-data pixels, bytes against dense
+    int status = 0;
 
-    /* LOGGING --------------------------------------------- */
-    
-    LOG4CXX_INFO(Logger::get(), "main: ProductId = " << h.getPI());
-    LOG4CXX_INFO(Logger::get(), "main: timestamp = " << h.getTS());
-    LOG4CXX_INFO(Logger::get(), "main: WMO       = " << h.getWN());
-    
-    
-    /* read non-positional data --------------------------------------------- */
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+            continue;
+        }
 
-    /* "... der Parser (sollte) so implementiert sein, dass er den Inhalt (...)
-     *  anhand der jeweils einleitenden Kennung verarbeitet." */
+        try {
+            MappedFile f{std::string(r.header.getFN())};
+            SparseGrid s = decodeSparse(f, r.etxIndex, r.header);
+            Summary sum = summarize(s);
 
+            size_t dense = size_t(s.getRows()) * s.getCols() * (sizeof(float) + sizeof(uint8_t));
 
-    // start looking for identifiers at byte 17, read until `etxIndex`
+            cout << r.header.getFN() << ": " << s.getEntries() << " entries, " << s.countNoData() << " no data, " <<
+                sum.wet << " wet, " << s.getBytes() / 1e3 << " kB (" << std::setprecision(1) << std::fixed <<
+                double(dense) / s.getBytes() << "x smaller than dense)" << endl;
+            cout.unsetf(std::ios::fixed);
+            cout << std::setprecision(6);
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
 
-    long i = 17;
+    return status;
+}
 
+static int printCoords(const std::vector<Result>& results, const std::string& dir, const std::string& points, unsigned jobs) {
 
-    // we expect 9 other key-value pairs; while-loop would be another option;
-    for (int j = 0; j<9; j++)
+    int status = 0;
+
+    // one table per grid size; in a mixed directory, points go to the first
+    std::vector<std::pair<int, int>> grids;
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+            continue;
+        }
+        std::pair<int, int> g{r.header.getRows(), r.header.getCols()};
+        if (std::find(grids.begin(), grids.end(), g) == grids.end())
+            grids.push_back(g);
+    }
+
+    std::vector<CoordTable> tables;
+
+    for (auto [rows, cols] : grids) {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            bool built;
+            tables.push_back(loadCoordTable(dir, rows, cols, jobs, &built));
+            double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3;
+
+            const CoordTable& t = tables.back();
+            std::cerr << rows << "x" << cols << ": " << (built ? "built" : "loaded") << " in " << ms << " ms, " << t.getBuckets() << " buckets, centres" <<
+                " SW " << t.getLat(0, 0) << "," << t.getLon(0, 0) << " NE " << t.getLat(rows - 1, cols - 1) << "," << t.getLon(rows - 1, cols - 1) << std::endl;
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    if (points.empty() || tables.empty())
+        return status;
+
+    // `lat lon` or `lat,lon` per line; `#` starts a comment
+    std::vector<float> lats, lons;
     {
-        // get mapping and bytes
-        // NOTE: mapping is passed by reference → no special syntax required!
-        auto [mm, by] = parse(hb, i, metainfo);
+        std::ifstream in(points);
+        if (!in) {
+            std::cerr << "Could not open file " << points << std::endl;
+            return 1;
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            std::replace(line.begin(), line.end(), ',', ' ');
+            std::istringstream ss(line);
+            float la, lo;
+            if (ss >> la >> lo) {
+                lats.push_back(la);
+                lons.push_back(lo);
+            }
+        }
+    }
 
-        
-        LOG4CXX_INFO(Logger::get(), "main: getKey : " << mm.getKey() << " (" << mm.getKeyLen() << "+" << mm.getValLen() << "=" << mm.getLen() << ")");
-        
-        std::string logs;
-        for (auto b : by) 
-            logs += b;
-        LOG4CXX_INFO(Logger::get(), "main: buff   : " << logs);
-        
-        LOG4CXX_INFO(Logger::get(), "main: i: " << i << " -> " << (i+mm.getLen()));
-        
-        // get setter function from mapping and assign respective value
-        MetaInfo::SetterFunction setterFunc = mm.getSetter();
-        (h.*setterFunc)(by); 
+    std::vector<int32_t> rows(lats.size()), cols(lats.size());
 
-        // add number of processed bytes to index i
-        i += mm.getLen();
+    auto start = std::chrono::steady_clock::now();
+    tables[0].locate(lats.data(), lons.data(), lats.size(), rows.data(), cols.data(), jobs);
+    double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3;
+    std::cerr << lats.size() << " points in " << ms << " ms" << std::endl;
 
+    Writer w(STDOUT_FILENO);
+    w.put("lat,lon,row,col\n");
+    for (size_t i = 0; i < lats.size(); i++) {
+        w.putFixed(lats[i], 5);   w.put(',');
+        w.putFixed(lons[i], 5);   w.put(',');
+        w.putInt(rows[i]);        w.put(',');
+        w.putInt(cols[i]);        w.put('\n');
+    }
+    w.flush();
 
-        // in case we arrived at "MS", read in the subsequent text
-        if (mm.getKey() == "MS")
-        {
-            // get length of text in byte
-            int textLen = h.getMS();
+    return status;
+}
 
-            // read in text
-            std::string text(hb.begin()+i, hb.begin()+i+textLen);
+static int checkFiles(const std::vector<std::string>& files, unsigned jobs) {
 
-            LOG4CXX_INFO(Logger::get(), "main: text : " << text);
+    // one line per file: `<STATUS> <file>[: <detail>]`; fails if any file does
+    int status = 0;
 
-            // set header attribute
-            h.setText(text);
+    for (const Check& c : checkBatch(files, jobs)) {
+        cout << integrityName(c.status) << " " << c.file;
+        if (c.status != Integrity::OK) {
+            cout << ": " << c.detail;
+            status = 1;
+        }
+        cout << "\n";
+    }
+    cout << std::flush;
+
+    return status;
+}
 
-            LOG4CXX_INFO(Logger::get(), "main: i: " << i << " -> " << (i+textLen));
 
-            // update index
-            i += textLen;
+static int printZones(const std::vector<Result>& results, const std::string& path, Layout layout, unsigned jobs) {
+
+    int status = 0;
+
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
         }
+    }
 
+    // regions are loaded once per grid among the runs
+    std::vector<RegionIndex> indexes;
+
+    cout << "PI,TS,region,VV,pixels,valid,wet,coverage,sum,mean,max\n";
+
+    for (const std::vector<Result>& run : groupRuns(results)) {
+        try {
+            Cube c = loadCube(run, layout, jobs);
+            const RegionIndex& index = indexes[regionsFor(indexes, path, c.getRows(), c.getCols())];
+
+            std::vector<ZoneStats> stats = zonalStats(c, index, jobs);
+            const std::vector<Header>& headers = c.getHeaders();
+            const size_t steps = headers.size();
+
+            for (size_t k = 0; k < index.getRegions(); k++) {
+                for (size_t s = 0; s < steps; s++) {
+                    const ZoneStats& z = stats[k * steps + s];
+                    cout << c.getPI() << "," << c.getTS() << "," << index.getId(k) << "," << headers[s].getVV() << "," <<
+                        z.pixels << "," << z.valid << "," << z.wet << "," << z.coverage() << "," <<
+                        z.sum << "," << z.mean() << "," << (z.valid ? z.max : 0.0f) << "\n";
+                }
+            }
+            cout << std::flush;
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
     }
 
-    // print header to console
-    cout << h << endl;
+    return status;
+}
+
+
+static int writeTiles(const std::vector<Result>& results, const std::string& dir, Aggregation agg, unsigned jobs) {
+
+    int status = 0;
+
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+        }
+    }
+
+    try {
+        TileCache cache(dir);
+        std::vector<Grid> levels;
 
-    // exit with status code 0
+        for (const std::vector<Result>& run : groupRuns(results)) {
+            Cube c = loadCube(run, Layout::STEP_MAJOR, jobs);
+            const size_t size = size_t(c.getRows()) * c.getCols();
+
+            // successive steps share the pyramid grids and the tile store
+            for (int s = 0; s < c.getSteps(); s++) {
+                const Header& h = c.getHeaders()[s];
+                size_t before = cache.getWritten();
+
+                buildPyramid(c.getValues() + s * size, c.getRows(), c.getCols(), agg, levels);
+                std::vector<TileRef> refs = cache.update(levels);
+
+                // manifest of the step: `<level> <row> <col> <hash>` per tile
+                std::string name = std::filesystem::path(std::string(h.getFN())).filename().string();
+                std::ofstream out(std::filesystem::path(dir) / (name + ".tiles"));
+                for (const TileRef& t : refs)
+                    out << t.level << " " << t.row << " " << t.col << " " << std::hex << std::setw(16) << std::setfill('0') << t.hash << std::dec << "\n";
+                if (!out)
+                    throw std::runtime_error("writeTiles: unable to write the manifest of " + name);
+
+                cout << name << ": " << levels.size() << " levels, " << refs.size() << " tiles, " << cache.getWritten() - before << " written\n";
+            }
+        }
+        cout << std::flush;
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("main: " << e.what());
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+
+    return status;
+}
+
+
+static int saveCaches(const std::vector<Result>& results, const std::string& dir) {
+
+    int status = 0;
+
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+        }
+    }
+
+    // one cache file per run, named after PI and TS
+    for (const std::vector<Result>& run : groupRuns(results)) {
+
+        const Header& h = run[0].header;
+        std::string path = dir + "/" + std::string(h.getPI()) + std::string(h.getTS()) + ".prvc";
+
+        try {
+            size_t raw = 0;
+            for (const Result& r : run)
+                raw += size_t(r.header.getBY());
+
+            size_t bytes = writeCache(run, path);
+            cout << "Cache of " << h.getPI() << " run '" << h.getTS() << "': " << path << " (" << run.size() << " steps, " <<
+                bytes / 1e3 << " kB, " << std::setprecision(1) << std::fixed << double(raw) / bytes << "x smaller)" << endl;
+            cout.unsetf(std::ios::fixed);
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+static int loadCaches(const std::vector<std::string>& paths, Layout layout, unsigned jobs) {
+
+    int status = 0;
+    bool first = true;
+
+    for (const std::string& path : paths) {
+
+        // separate cubes by an empty line
+        if (!first)
+            cout << "\n";
+        first = false;
+
+        try {
+            printCube(loadCache(path, layout, jobs));
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+
+static int writeDeltas(const std::vector<Result>& results, const std::string& dir) {
+
+    int status = 0;
+
+    for (const Result& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << r.error << std::endl;
+            status = 1;
+        }
+    }
+
+    try {
+        // one delta per step that has a predecessor with the same valid time,
+        // named after the target file
+        for (const auto& [base, target] : alignRuns(groupRuns(results))) {
+
+            std::string name = std::filesystem::path(std::string(target.header.getFN())).filename().string();
+            std::string path = (std::filesystem::path(dir) / (name + ".prvd")).string();
+
+            try {
+                DeltaHeader dh = writeDelta(base, target, path);
+                size_t bytes = std::filesystem::file_size(path);
+
+                cout << name << ": base " << std::filesystem::path(std::string(base.header.getFN())).filename().string() <<
+                    ", " << dh.changed << " of " << size_t(dh.rows) * dh.cols << " pixels changed, " <<
+                    bytes / 1e3 << " kB (" << std::setprecision(1) << std::fixed << double(target.header.getBY()) / bytes << "x smaller)" << endl;
+                cout.unsetf(std::ios::fixed);
+                cout << std::setprecision(6);
+            }
+            catch (const std::exception& e) {
+                LOG_ERROR("main: " << e.what());
+                std::cerr << e.what() << std::endl;
+                status = 1;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        // malformed TS
+        LOG_ERROR("main: " << e.what());
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+
+    return status;
+}
+
+static int reconstructFile(const std::vector<std::string>& inputs, const std::string& out) {
+
+    // inputs[0] is the base, all others are deltas in the order to apply
+    try {
+        std::vector<char> file = reconstruct(inputs[0], std::vector<std::string>(inputs.begin() + 1, inputs.end()));
+
+        std::ofstream os(out, std::ios::binary | std::ios::trunc);
+        os.write(file.data(), file.size());
+        if (!os)
+            throw std::runtime_error("reconstruct: unable to write " + out);
+
+        cout << out << ": " << inputs[0] << " + " << inputs.size() - 1 << " deltas, " << file.size() << " bytes" << endl;
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("main: " << e.what());
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+static int serve(const std::vector<Result>& results, const std::string& socket, const std::string& zones, unsigned jobs) {
+
+    // errors while loading are reported, the remaining runs are still served
+    for (const Result& r : results)
+        if (!r.error.empty())
+            std::cerr << r.error << std::endl;
+
+    try {
+        Snapshot s(results, zones, jobs);
+        for (const std::string& w : s.getWarnings())
+            std::cerr << w << std::endl;
+        std::cerr << "Serving " << s.getCubes().size() << " runs on " << socket << std::endl;
+        serveSocket(s, socket, jobs);
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("main: " << e.what());
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
     return 0;
+}
+
+
+static int printWindows(const std::vector<Result>& results, const std::vector<int>& w) {
+
+    int status = 0;
+    bool first = true;
+
+    for (const std::vector<Result>& run : groupRuns(results)) {
+
+        // separate runs by an empty line
+        if (!first)
+            cout << "\n";
+        first = false;
+
+        try {
+            std::vector<Grid> grids = queryWindow(run, w[0], w[1], w[2], w[3]);
+
+            if (w[0] == w[2] && w[1] == w[3])
+                cout << "Point (" << w[0] << "," << w[1] << ")";
+            else
+                cout << "Window (" << w[0] << "," << w[1] << ")-(" << w[2] << "," << w[3] << ")";
+            cout << " of " << run[0].header.getPI() << " run '" << run[0].header.getTS() << "'\n";
+
+            for (size_t s = 0; s < grids.size(); s++) {
+                const Grid& g = grids[s];
+                cout << " VV " << std::setw(3) << std::setfill('0') << run[s].header.getVV() << std::setfill(' ') << ":";
+
+                // points fit on one line, windows are printed row by row
+                for (int row = 0; row < g.getRows(); row++) {
+                    if (g.getSize() > 1)
+                        cout << "\n ";
+                    for (int col = 0; col < g.getCols(); col++)
+                        printValue(cout, g, size_t(row) * g.getCols() + col);
+                }
+                cout << "\n";
+            }
+            cout << std::flush;
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+
+/* MAIN --------------------------------------------------------------------- */
+
+int main(int argc, char* argv[]) {
+
+    /* handle arguments ----------------------------------------------------- */
+
+    // read options; all remaining arguments are files, directories, globs or
+    // `@list` files (see `collectFiles`)
+    std::vector<std::string> inputs;
+    bool decode = false;
+    bool check = false;
+    bool cube = false;
+    Layout layout = Layout::STEP_MAJOR;
+    std::vector<int> window;
+    std::string watchDir;
+    std::string cacheDir;
+    bool fromCache = false;
+    std::string deltaDir;
+    std::string coordsDir;
+    std::string points;
+    std::string reconstructOut;
+    bool sparse = false;
+    bool products = false;
+    std::vector<float> thresholds = {1.0f, 5.0f, 10.0f};
+    std::string zones;
+    std::string tilesDir;
+    Aggregation aggregation = Aggregation::MEAN;
+    Format format = Format::TEXT;
+    unsigned jobs = 0;
+    IoBackend io = IoBackend::MMAP;
+    bool stats = false;
+    bool server = false;
+    std::string socket;
+    std::string statsFile;
+
+    // NOTE: malformed numbers make std::stoi throw → usage
+    try {
+        for (int a = 1; a < argc; a++) {
+            string arg = argv[a];
+            if (arg == "serve" && a == 1)
+                server = true;
+            else if (arg == "--socket" && a+1 < argc)
+                socket = argv[++a];
+            else if (arg == "--decode")
+                decode = true;
+            else if (arg == "--check")
+                check = true;
+            else if (arg == "--format" && a+1 < argc)
+                format = parseFormat(argv[++a]);
+            else if (arg.rfind("--format=", 0) == 0)
+                format = parseFormat(arg.substr(9));
+            else if (arg == "--cube")
+                cube = true;
+            else if (arg == "--layout" && a+1 < argc)
+                layout = parseLayout(argv[++a]);
+            else if (arg == "--at" && a+1 < argc) {
+                // a point is a window of one pixel
+                std::vector<int> p = parseInts(argv[++a]);
+                if (p.size() != 2)
+                    throw std::invalid_argument("--at requires <row,col>");
+                window = {p[0], p[1], p[0], p[1]};
+            }
+            else if (arg == "--window" && a+1 < argc)
+                window = parseInts(argv[++a]);
+            else if (arg == "--sparse")
+                sparse = true;
+            else if (arg == "--products")
+                products = true;
+            else if (arg == "--thresholds" && a+1 < argc)
+                thresholds = parseFloats(argv[++a]);
+            else if (arg == "--zones" && a+1 < argc)
+                zones = argv[++a];
+            else if (arg == "--tiles" && a+1 < argc)
+                tilesDir = argv[++a];
+            else if (arg == "--aggregate" && a+1 < argc)
+                aggregation = parseAggregation(argv[++a]);
+            else if (arg == "--save-cache" && a+1 < argc)
+                cacheDir = argv[++a];
+            else if (arg == "--load-cache")
+                fromCache = true;
+            else if (arg == "--delta" && a+1 < argc)
+                deltaDir = argv[++a];
+            else if (arg == "--coords" && a+1 < argc)
+                coordsDir = argv[++a];
+            else if (arg == "--locate" && a+1 < argc)
+                points = argv[++a];
+            else if (arg == "--reconstruct" && a+1 < argc)
+                reconstructOut = argv[++a];
+            else if (arg == "--watch" && a+1 < argc)
+                watchDir = argv[++a];
+            else if (arg == "--stats")
+                stats = true;
+            else if (arg == "--stats-file" && a+1 < argc)
+                statsFile = argv[++a];
+            else if (arg == "--async-log")
+                Logger::setAsync(true);
+            else if (arg == "--io" && a+1 < argc)
+                io = parseIoBackend(argv[++a]);
+            else if ((arg == "-j" || arg == "--jobs") && a+1 < argc)
+                jobs = std::stoi(argv[++a]);
+            else
+                inputs.push_back(arg);
+        }
+    }
+    catch (const std::exception&) {
+        inputs.clear();
+    }
+
+    // from here on, every return path reports the stats
+    Stats::enable(stats || !statsFile.empty());
+    StatsReport report(stats ? &std::cerr : nullptr, statsFile);
+
+    // long-running mode: no further inputs
+    if (!watchDir.empty() && !inputs.empty()) {
+        LOG_ERROR("main: --watch takes no further inputs!");
+        usage(argv[0]);
+        return 1;
+    }
+    if (!watchDir.empty())
+        return watch(watchDir, decode, format);
+
+    // check if user provided a filename and a valid point or window
+    if (inputs.empty() || (!window.empty() && window.size() != 4) || server != !socket.empty() || (!points.empty() && coordsDir.empty())) {
+        LOG_ERROR("main: invalid program invocation!");
+        usage(argv[0]);
+
+        // return with error
+        return 1;
+    }
+
+
+    // cache files are not RV files, hence they bypass `collectFiles`
+    if (fromCache)
+        return loadCaches(inputs, layout, jobs);
+
+    // as are deltas, and the base must come first
+    if (!reconstructOut.empty())
+        return reconstructFile(inputs, reconstructOut);
+
+
+    /* handle files --------------------------------------------------------- */
+
+    // NOTE: these modes map every file again by its name (e.g. to decode it
+    //       into a cube), which archive members and stdin do not have
+    bool reopens = cube || sparse || products || !zones.empty() || !tilesDir.empty() || !window.empty() || !cacheDir.empty() || !deltaDir.empty() || server;
+    if (reopens && std::any_of(inputs.begin(), inputs.end(), isStream)) {
+        LOG_ERROR("main: archives and stdin are read once, this mode needs the files on disk!");
+        usage(argv[0]);
+        return 1;
+    }
+
+    // integrity gate: regular files only, nothing beyond the header is read
+    if (check) {
+        try {
+            return checkFiles(collectFiles(inputs), jobs);
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("main: " << e.what());
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // stdin and tar archives are parsed as streams, everything else is mapped
+    std::vector<std::string> files;
+    std::vector<std::string> streams;
+    try {
+        std::vector<std::string> paths;
+        for (const std::string& in : inputs)
+            (isStream(in) ? streams : paths).push_back(in);
+
+        files = collectFiles(paths);
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("main: " << e.what());
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // parse all files on a worker pool; results come back sorted by PI, TS and VV
+    // NOTE: cubes and queries read the payload themselves
+    bool headersOnly = reopens || !coordsDir.empty();
+    std::vector<Result> results = scanBatch(files, decode && !headersOnly, io, jobs);
+
+    if (!streams.empty()) {
+        for (const std::string& path : streams)
+            for (Result& r : processStream(path, decode && !headersOnly))
+                results.push_back(std::move(r));
+        sortResults(results);
+    }
+
+
+    /* print results -------------------------------------------------------- */
+
+    if (server)
+        return serve(results, socket, zones, jobs);
+
+    if (!coordsDir.empty())
+        return printCoords(results, coordsDir, points, jobs);
+
+    if (!deltaDir.empty())
+        return writeDeltas(results, deltaDir);
+
+    if (!cacheDir.empty())
+        return saveCaches(results, cacheDir);
+
+    if (!tilesDir.empty())
+        return writeTiles(results, tilesDir, aggregation, jobs);
+
+    if (!zones.empty())
+        return printZones(results, zones, layout, jobs);
+
+    if (sparse)
+        return printSparse(results);
+
+    if (products)
+        return printProducts(results, thresholds, jobs);
+
+    if (cube)
+        return printCubes(results, layout, jobs);
+
+    if (!window.empty())
+        return printWindows(results, window);
+
+    if (format != Format::TEXT)
+        return writeRecords(results, format, decode);
+
+    return printHeaders(results);
 
 }
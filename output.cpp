@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+#include "classes.h"
+#include "output.h"
+
+using namespace std;
+
+
+/* FORMATS ------------------------------------------------------------------ */
+
+Format parseFormat(std::string_view s)
+{
+    if (s == "text")
+        return Format::TEXT;
+    if (s == "jsonl")
+        return Format::JSONL;
+    if (s == "csv")
+        return Format::CSV;
+    if (s == "bin")
+        return Format::BIN;
+
+    throw std::invalid_argument("parseFormat: unknown format '" + std::string(s) + "'!");
+}
+
+
+/* WRITER ------------------------------------------------------------------- */
+
+// constructor A
+Writer::Writer(int fd, size_t capacity) : fd(fd), buffer(capacity), used(0) {}
+
+// destructor: write out what is left
+Writer::~Writer()
+{
+    try {
+        flush();
+    }
+    catch (const std::exception&) {}
+}
+
+void Writer::reserve(size_t n)
+{
+    if (used + n > buffer.size())
+        flush();
+
+    // a single piece larger than the buffer, e.g. a long text with a tiny buffer
+    if (n > buffer.size())
+        buffer.resize(n);
+}
+
+void Writer::put(char c)
+{
+    reserve(1);
+    buffer[used++] = c;
+}
+
+void Writer::put(std::string_view s)
+{
+    reserve(s.size());
+    std::memcpy(buffer.data() + used, s.data(), s.size());
+    used += s.size();
+}
+
+void Writer::putInt(long v)
+{
+    // 20 digits and a sign cover every long
+    reserve(21);
+    used = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), v).ptr - buffer.data();
+}
+
+void Writer::putFixed(double v, int decimals, std::string_view none)
+{
+    // the fraction digits go through a 9-byte buffer, and 10^9 fits into long
+    if (decimals < 0 || decimals > 9)
+        throw std::invalid_argument("putFixed: decimals must be within 0 and 9!");
+
+    // NaN (no data) and infinities have no digits
+    if (!std::isfinite(v)) {
+        put(none);
+        return;
+    }
+
+    // scaled to an integer, hence no floating-point to_chars is needed
+    long scale = 1;
+    for (int k = 0; k < decimals; k++)
+        scale *= 10;
+
+    // NOTE: beyond the range of long, lround is undefined; rare, hence printf
+    if (std::fabs(v) * scale >= 9e18) {
+        char s[400];
+        int len = std::snprintf(s, sizeof(s), "%.*f", decimals, v);
+        put(std::string_view(s, size_t(len)));
+        return;
+    }
+
+    long n = std::lround(v * scale);
+    if (n < 0) {
+        put('-');
+        n = -n;
+    }
+    putInt(n / scale);
+
+    if (decimals > 0) {
+        char digits[9];
+        long f = n % scale;
+        for (int k = decimals - 1; k >= 0; k--, f /= 10)
+            digits[k] = char('0' + f % 10);
+
+        put('.');
+        put(std::string_view(digits, decimals));
+    }
+}
+
+void Writer::putU16(uint16_t v)
+{
+    reserve(2);
+    buffer[used++] = char(v & 0xFF);
+    buffer[used++] = char(v >> 8);
+}
+
+void Writer::putI32(int32_t v)
+{
+    reserve(4);
+    uint32_t u = static_cast<uint32_t>(v);
+    for (int k = 0; k < 4; k++)
+        buffer[used++] = char((u >> (8 * k)) & 0xFF);
+}
+
+void Writer::putF32(float v)
+{
+    // IEEE 754 bits, little-endian as the integers
+    uint32_t u;
+    std::memcpy(&u, &v, 4);
+    putI32(static_cast<int32_t>(u));
+}
+
+void Writer::flush()
+{
+    size_t done = 0;
+
+    while (done < used)
+    {
+        ssize_t n = ::write(fd, buffer.data() + done, used - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            used = 0;
+            throw std::runtime_error("Writer: unable to write output");
+        }
+        done += size_t(n);
+    }
+    used = 0;
+}
+
+
+/* JSON LINES --------------------------------------------------------------- */
+
+static void putJsonString(Writer& w, std::string_view s)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    w.put('"');
+
+    // copy spans that need no escaping in one piece
+    size_t start = 0;
+    for (size_t k = 0; k < s.size(); k++)
+    {
+        unsigned char u = static_cast<unsigned char>(s[k]);
+        if (u >= 0x20 && u != '"' && u != '\\')
+            continue;
+
+        w.put(s.substr(start, k - start));
+        start = k + 1;
+
+        if (u >= 0x20) {
+            w.put('\\');
+            w.put(s[k]);
+        }
+        else {
+            // control characters as \u00XX
+            w.put("\\u00");
+            w.put(HEX[u >> 4]);
+            w.put(HEX[u & 0xF]);
+        }
+    }
+    w.put(s.substr(start));
+    w.put('"');
+}
+
+static void writeJson(Writer& w, const Header& h, const Summary* s)
+{
+    w.put("{\"FN\":");   putJsonString(w, h.getFN());
+    w.put(",\"PI\":");   putJsonString(w, h.getPI());
+    w.put(",\"TS\":");   putJsonString(w, h.getTS());
+    w.put(",\"WMO\":");  putJsonString(w, h.getWN());
+    w.put(",\"BY\":");   w.putInt(h.getBY());
+    w.put(",\"VS\":");   w.putInt(h.getVS());
+    w.put(",\"SW\":");   putJsonString(w, h.getSW());
+    w.put(",\"PR\":");   putJsonString(w, h.getPR());
+    w.put(",\"IN\":");   w.putInt(h.getIN());
+    w.put(",\"GP\":");   putJsonString(w, h.getGP());
+    w.put(",\"VV\":");   w.putInt(h.getVV());
+    w.put(",\"MF\":");   putJsonString(w, h.getMF());
+    w.put(",\"MS\":");   w.putInt(h.getMS());
+    w.put(",\"TX\":");   putJsonString(w, h.getText());
+    if (s != nullptr) {
+        w.put(",\"pixels\":");   w.putInt(long(s->pixels));
+        w.put(",\"nodata\":");   w.putInt(long(s->nodata));
+        w.put(",\"clutter\":");  w.putInt(long(s->clutter));
+        w.put(",\"wet\":");      w.putInt(long(s->wet));
+        w.put(",\"max\":");      w.putFixed(s->max, 2, "null");
+    }
+    w.put("}\n");
+}
+
+
+/* CSV ---------------------------------------------------------------------- */
+
+static void putCsvField(Writer& w, std::string_view s)
+{
+    // quote only fields that need it; quotes inside are doubled
+    if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+        w.put(s);
+        return;
+    }
+
+    w.put('"');
+    for (size_t k; (k = s.find('"')) != std::string_view::npos; s.remove_prefix(k + 1)) {
+        w.put(s.substr(0, k + 1));
+        w.put('"');
+    }
+    w.put(s);
+    w.put('"');
+}
+
+static void writeCsv(Writer& w, const Header& h, const Summary* s)
+{
+    putCsvField(w, h.getFN());   w.put(',');
+    putCsvField(w, h.getPI());   w.put(',');
+    putCsvField(w, h.getTS());   w.put(',');
+    putCsvField(w, h.getWN());   w.put(',');
+    w.putInt(h.getBY());         w.put(',');
+    w.putInt(h.getVS());         w.put(',');
+    putCsvField(w, h.getSW());   w.put(',');
+    putCsvField(w, h.getPR());   w.put(',');
+    w.putInt(h.getIN());         w.put(',');
+    putCsvField(w, h.getGP());   w.put(',');
+    w.putInt(h.getVV());         w.put(',');
+    putCsvField(w, h.getMF());   w.put(',');
+    w.putInt(h.getMS());         w.put(',');
+    putCsvField(w, h.getText());
+    if (s != nullptr) {
+        w.put(',');  w.putInt(long(s->pixels));
+        w.put(',');  w.putInt(long(s->nodata));
+        w.put(',');  w.putInt(long(s->clutter));
+        w.put(',');  w.putInt(long(s->wet));
+        w.put(',');  w.putFixed(s->max, 2);
+    }
+    w.put("\r\n");
+}
+
+
+/* BINARY ------------------------------------------------------------------- */
+
+static void putFixed(Writer& w, std::string_view s, size_t width)
+{
+    // exactly `width` bytes: the field, padded with '\0'
+    s = s.substr(0, width);
+    w.put(s);
+    for (size_t k = s.size(); k < width; k++)
+        w.put('\0');
+}
+
+static void writeBinary(Writer& w, const Header& h, const Summary* s)
+{
+    const size_t FIXED = 2 + 10 + 5 + 8 + 4 + 9 + 8;
+    const size_t INTS = 7 * 4;
+    const size_t SUMMARY = s != nullptr ? 4 * 4 + 4 : 0;
+
+    // NOTE: FN and TX are cut at 65535 bytes to fit their length fields
+    std::string_view fn = h.getFN().substr(0, 0xFFFF);
+    std::string_view tx = h.getText().substr(0, 0xFFFF);
+
+    w.putI32(static_cast<int32_t>(4 + FIXED + INTS + 2 + fn.size() + 2 + tx.size() + SUMMARY));
+
+    putFixed(w, h.getPI(), 2);
+    putFixed(w, h.getTS(), 10);
+    putFixed(w, h.getWN(), 5);
+    putFixed(w, h.getSW(), 8);
+    putFixed(w, h.getPR(), 4);
+    putFixed(w, h.getGP(), 9);
+    putFixed(w, h.getMF(), 8);
+
+    w.putI32(h.getBY());
+    w.putI32(h.getVS());
+    w.putI32(h.getIN());
+    w.putI32(h.getVV());
+    w.putI32(h.getMS());
+    w.putI32(h.getRows());
+    w.putI32(h.getCols());
+
+    w.putU16(static_cast<uint16_t>(fn.size()));
+    w.put(fn);
+    w.putU16(static_cast<uint16_t>(tx.size()));
+    w.put(tx);
+
+    if (s != nullptr) {
+        w.putI32(static_cast<int32_t>(s->pixels));
+        w.putI32(static_cast<int32_t>(s->nodata));
+        w.putI32(static_cast<int32_t>(s->clutter));
+        w.putI32(static_cast<int32_t>(s->wet));
+        w.putF32(s->max);
+    }
+}
+
+
+/* RECORDS ------------------------------------------------------------------ */
+
+void writeHead(Writer& w, Format f, bool decoded)
+{
+    if (f != Format::CSV)
+        return;
+    w.put("FN,PI,TS,WMO,BY,VS,SW,PR,IN,GP,VV,MF,MS,TX");
+    if (decoded)
+        w.put(",pixels,nodata,clutter,wet,max");
+    w.put("\r\n");
+}
+
+void writeRecord(Writer& w, const Header& h, Format f, const Summary* s)
+{
+    switch (f)
+    {
+        case Format::JSONL: writeJson(w, h, s); break;
+        case Format::CSV:   writeCsv(w, h, s); break;
+        case Format::BIN:   writeBinary(w, h, s); break;
+        case Format::TEXT:  throw std::invalid_argument("writeRecord: TEXT is written through operator<<!");
+    }
+}
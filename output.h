@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "classes.h"
+#include "payload.h"
+
+
+/* FORMATS ------------------------------------------------------------------ */
+
+// TEXT   human-readable block, see `operator<<(std::ostream&, const Header&)`
+// JSONL  one JSON object per header and line
+// CSV    RFC 4180, one header line with the column names, then one row per header
+// BIN    length-prefixed binary records, see `writeRecord`
+
+enum class Format { TEXT, JSONL, CSV, BIN };
+
+// "text", "jsonl", "csv" or "bin"; throws std::invalid_argument otherwise
+Format parseFormat(std::string_view s);
+
+
+/* WRITER ------------------------------------------------------------------- */
+
+// Buffered output to a file descriptor. Numbers are formatted with
+// `std::to_chars` straight into the buffer, hence writing records does not
+// allocate; the buffer is written with one `write` call whenever it is full.
+
+class Writer {
+private:
+    int fd;
+    std::vector<char> buffer;
+    size_t used;
+
+    // make room for at least n bytes
+    void reserve(size_t n);
+
+public:
+    explicit Writer(int fd, size_t capacity = 1 << 16);
+    ~Writer();                // flushes; errors are ignored here
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void put(char c);
+    void put(std::string_view s);
+    void putInt(long v);
+
+    // v rounded to `decimals` places, e.g. "1.25"; `none` for NaN and
+    // infinities, i.e. an empty field by default, "null" for JSON; throws
+    // std::invalid_argument unless 0 <= decimals <= 9
+    void putFixed(double v, int decimals, std::string_view none = {});
+
+    // little-endian fixed-width integers for binary records
+    void putU16(uint16_t v);
+    void putI32(int32_t v);
+    void putF32(float v);
+
+    // write out the buffer; throws std::runtime_error if the write fails
+    void flush();
+};
+
+
+/* RECORDS ------------------------------------------------------------------ */
+
+// All formats carry every field of the header: FN, PI, TS, WMO, BY, VS, SW,
+// PR, IN, GP, VV, MF, MS and TX.
+//
+// BIN records (all integers little-endian):
+//
+//  uint32  size of the record in bytes, including this field
+//  char    PI[2] TS[10] WMO[5] SW[8] PR[4] GP[9] MF[8]  ('\0'-padded)
+//  int32   BY VS IN VV MS rows cols
+//  uint16  length of FN, followed by FN
+//  uint16  length of TX, followed by TX
+//
+// With a payload summary (`--decode`), every format adds the fields pixels,
+// nodata, clutter, wet and max (see `Summary`); BIN records then end with
+//
+//  int32   pixels nodata clutter wet
+//  float32 max
+
+// column names line, with the summary columns if `decoded`; CSV only, a
+// no-op for the other formats
+void writeHead(Writer& w, Format f, bool decoded = false);
+
+// one header in format f (not TEXT), followed by the payload summary s unless
+// it is nullptr
+void writeRecord(Writer& w, const Header& h, Format f, const Summary* s = nullptr);
@@ -0,0 +1,270 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRVH_X86 1
+#endif
+
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "traits.h"
+
+using namespace std;
+
+
+/* GRID --------------------------------------------------------------------- */
+
+// constructor A and B
+Grid::Grid() : rows(0), cols(0) {}
+Grid::Grid(int r, int c) : rows(r), cols(c), values(size_t(r) * c), mask(size_t(r) * c) {}
+
+// destructor: for now empty, as vectors clean up after themselves
+Grid::~Grid() {}
+
+const int Grid::getRows() const { return rows; }
+const int Grid::getCols() const { return cols; }
+const size_t Grid::getSize() const { return values.size(); }
+
+float* Grid::getValues() { return values.data(); }
+const float* Grid::getValues() const { return values.data(); }
+uint8_t* Grid::getMask() { return mask.data(); }
+const uint8_t* Grid::getMask() const { return mask.data(); }
+
+
+/* KERNELS ------------------------------------------------------------------ */
+
+// All kernels share the same contract: decode n words starting at src, where
+// src need not be aligned. The vector kernels handle full blocks of 16 words
+// and leave the remainder to the scalar kernel.
+
+static void decodeScalar(const char* src, size_t n, float factor, float* values, uint8_t* mask)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(src);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        // assemble little-endian word independent of host byte order
+        uint16_t w = uint16_t(p[2*i] | (p[2*i+1] << 8));
+
+        float v = (w & PIXEL_VALUE) * factor;
+        if (w & PIXEL_NEGATIVE)
+            v = -v;
+        if (w & PIXEL_NODATA)
+            v = nan;
+
+        values[i] = v;
+        mask[i] = uint8_t(w >> 13);
+    }
+}
+
+#ifdef PRVH_X86
+
+__attribute__((target("sse4.1")))
+static void decodeSSE41(const char* src, size_t n, float factor, float* values, uint8_t* mask)
+{
+    const __m128i valueBits  = _mm_set1_epi32(PIXEL_VALUE);
+    const __m128i nodataBit  = _mm_set1_epi32(PIXEL_NODATA);
+    const __m128i negBit     = _mm_set1_epi32(PIXEL_NEGATIVE);
+    const __m128 f   = _mm_set1_ps(factor);
+    const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i + 16));
+
+        // flags: bits 13-15 shifted down, then packed to 16 bytes
+        __m128i m = _mm_packus_epi16(_mm_srli_epi16(a, 13), _mm_srli_epi16(b, 13));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), m);
+
+        // values: widen 4 words at a time to 32-bit lanes
+        __m128i words[4] = { a, _mm_srli_si128(a, 8), b, _mm_srli_si128(b, 8) };
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i w = _mm_cvtepu16_epi32(words[k]);
+            __m128 v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(w, valueBits)), f);
+
+            // move negative bit (14) into the float sign bit (31)
+            __m128i sign = _mm_slli_epi32(_mm_and_si128(w, negBit), 17);
+            v = _mm_xor_ps(v, _mm_castsi128_ps(sign));
+
+            __m128i nd = _mm_cmpeq_epi32(_mm_and_si128(w, nodataBit), nodataBit);
+            v = _mm_blendv_ps(v, nan, _mm_castsi128_ps(nd));
+
+            _mm_storeu_ps(values + i + 4*k, v);
+        }
+    }
+
+    decodeScalar(src + 2*i, n - i, factor, values + i, mask + i);
+}
+
+__attribute__((target("avx2")))
+static void decodeAVX2(const char* src, size_t n, float factor, float* values, uint8_t* mask)
+{
+    const __m256i valueBits  = _mm256_set1_epi32(PIXEL_VALUE);
+    const __m256i nodataBit  = _mm256_set1_epi32(PIXEL_NODATA);
+    const __m256i negBit     = _mm256_set1_epi32(PIXEL_NEGATIVE);
+    const __m256 f   = _mm256_set1_ps(factor);
+    const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i + 16));
+
+        // flags: bits 13-15 shifted down, then packed to 16 bytes
+        __m128i m = _mm_packus_epi16(_mm_srli_epi16(a, 13), _mm_srli_epi16(b, 13));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), m);
+
+        // values: widen 8 words at a time to 32-bit lanes
+        __m128i words[2] = { a, b };
+        for (int k = 0; k < 2; k++)
+        {
+            __m256i w = _mm256_cvtepu16_epi32(words[k]);
+            __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(w, valueBits)), f);
+
+            // move negative bit (14) into the float sign bit (31)
+            __m256i sign = _mm256_slli_epi32(_mm256_and_si256(w, negBit), 17);
+            v = _mm256_xor_ps(v, _mm256_castsi256_ps(sign));
+
+            __m256i nd = _mm256_cmpeq_epi32(_mm256_and_si256(w, nodataBit), nodataBit);
+            v = _mm256_blendv_ps(v, nan, _mm256_castsi256_ps(nd));
+
+            _mm256_storeu_ps(values + i + 8*k, v);
+        }
+    }
+
+    // NOTE: the scalar tail is SSE code; clear the upper halves first, or every
+    // call pays an AVX-SSE transition (the compiler omits it on the tail call)
+    _mm256_zeroupper();
+    decodeScalar(src + 2*i, n - i, factor, values + i, mask + i);
+}
+
+#endif
+
+
+/* DISPATCH ----------------------------------------------------------------- */
+
+// typedef for a kernel function pointer
+using DecodeFunction = void (*)(const char*, size_t, float, float*, uint8_t*);
+
+struct DecodeKernel {
+    const char* name;
+    DecodeFunction func;
+};
+
+static DecodeKernel selectKernel()
+{
+    // pick the widest kernel supported by the CPU we are running on
+#ifdef PRVH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", decodeAVX2};
+    if (__builtin_cpu_supports("sse4.1"))
+        return {"sse4.1", decodeSSE41};
+#endif
+    return {"scalar", decodeScalar};
+}
+
+static const DecodeKernel& kernel()
+{
+    // NOTE: function-local static → selected once, thread-safe since C++11
+    static const DecodeKernel k = selectKernel();
+    return k;
+}
+
+const char* decodeKernel() { return kernel().name; }
+
+
+/* DECODER ------------------------------------------------------------------ */
+
+void decodePayload(const char* src, size_t n, float factor, float* values, uint8_t* mask)
+{
+    kernel().func(src, n, factor, values, mask);
+}
+
+
+void decodeRVP6(const char* src, size_t n, float* values, uint8_t* mask)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(src);
+
+    // NOTE: no branches, hence clang vectorizes this loop at -O2 by itself
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t b = p[i];
+        values[i] = b == RVP6_NODATA ? nan : b * 0.5f - 32.5f;
+        mask[i] = uint8_t((b == RVP6_NODATA) * FLAG_NODATA | (b == RVP6_CLUTTER) * FLAG_CLUTTER);
+    }
+}
+
+
+Grid decodeGrid(const MappedFile& f, long etxIndex, const Header& h)
+{
+    // The payload starts right after the ETX byte and holds rows x cols pixels.
+
+    if (etxIndex < 0)
+        throw std::invalid_argument("decodeGrid: no ETX byte, hence no payload!");
+
+    Grid g(h.getRows(), h.getCols());
+
+    size_t offset = size_t(etxIndex) + 1;
+    size_t needed = payloadBytes(h);
+
+    if (f.size() < offset + needed)
+    {
+        std::string msg = "decodeGrid: payload must be of size " + std::to_string(needed) + "!";
+        throw std::invalid_argument(msg);
+    }
+
+    LOG_INFO("decodeGrid: " << h.getRows() << "x" << h.getCols() << " " << h.getPI() << " pixels using " << decodeKernel() << " kernel");
+
+    decodeProduct(h.getPI(), f.data() + offset, g.getSize(), h.getFactor(), g.getValues(), g.getMask());
+
+    return g;
+}
+
+
+/* SUMMARY ------------------------------------------------------------------ */
+
+Summary summarize(const Grid& g)
+{
+    // summarize flags and precipitation over all pixels
+    Summary s;
+    s.pixels = g.getSize();
+
+    const float* values = g.getValues();
+    const uint8_t* mask = g.getMask();
+
+    for (size_t k = 0; k < g.getSize(); k++)
+    {
+        if (mask[k] & FLAG_NODATA) { s.nodata++; continue; }
+        if (mask[k] & FLAG_CLUTTER) s.clutter++;
+        if (values[k] > 0.0f) s.wet++;
+        if (values[k] > s.max) s.max = values[k];
+    }
+    return s;
+}
+
+std::ostream& operator<<(std::ostream& os, const Summary& s) {
+    os << 
+        "Payload (" << decodeKernel() << ")\n" <<
+        " pixels:  " << s.pixels << "\n" <<
+        " nodata:  " << s.nodata << "\n" <<
+        " clutter: " << s.clutter << "\n" <<
+        " wet:     " << s.wet << "\n" <<
+        " max:     " << s.max;
+
+    return os;
+}
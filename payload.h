@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "classes.h"
+
+
+/* PIXEL LAYOUT ------------------------------------------------------------- */
+
+// Each pixel ("Bildelement") after the ETX byte is a little-endian 2-byte word:
+//
+//  bits  0-11  data value (multiply by precision factor, see `PR`)
+//  bit     12  interpolated
+//  bit     13  no data ("Fehlkennung")
+//  bit     14  negative sign
+//  bit     15  clutter
+
+const uint16_t PIXEL_VALUE    = 0x0FFF;
+const uint16_t PIXEL_NODATA   = 0x2000;
+const uint16_t PIXEL_NEGATIVE = 0x4000;
+const uint16_t PIXEL_CLUTTER  = 0x8000;
+
+// bits of a decoded mask byte; NOTE: these are simply the raw bits 13 to 15
+// shifted down, i.e. `mask = word >> 13`
+const uint8_t FLAG_NODATA   = 0x01;
+const uint8_t FLAG_NEGATIVE = 0x02;
+const uint8_t FLAG_CLUTTER  = 0x04;
+
+// Reflectivity products (RX) store one byte per pixel instead, in RVP6 units:
+// dBZ = byte / 2 - 32.5, with two reserved values
+
+const uint8_t RVP6_CLUTTER = 249;
+const uint8_t RVP6_NODATA  = 250;
+
+
+/* GRID --------------------------------------------------------------------- */
+
+// decoded payload: one precipitation value and one flag byte per pixel,
+// stored row by row (rows x cols as given by `GP`)
+
+class Grid {
+private:
+    int rows;
+    int cols;
+
+    // precipitation values; NaN where FLAG_NODATA is set
+    std::vector<float> values;
+
+    // FLAG_* bits per pixel
+    std::vector<uint8_t> mask;
+
+public:
+    Grid();
+    Grid(int r, int c);
+    ~Grid();
+
+    const int getRows() const;
+    const int getCols() const;
+    const size_t getSize() const;
+
+    float* getValues();
+    const float* getValues() const;
+    uint8_t* getMask();
+    const uint8_t* getMask() const;
+};
+
+
+/* DECODER ------------------------------------------------------------------ */
+
+// decode n raw pixel words at src into values and mask (both n elements)
+void decodePayload(const char* src, size_t n, float factor, float* values, uint8_t* mask);
+
+// decode n RVP6 bytes at src into dBZ values and mask (see RVP6_*)
+void decodeRVP6(const char* src, size_t n, float* values, uint8_t* mask);
+
+// decode the payload after the ETX byte at etxIndex of the mapped file f, with
+// the decoder of its product (see traits.h)
+Grid decodeGrid(const MappedFile& f, long etxIndex, const Header& h);
+
+// name of the kernel selected at runtime ("avx2", "sse4.1" or "scalar")
+const char* decodeKernel();
+
+
+/* SUMMARY ------------------------------------------------------------------ */
+
+// flag counts and maximum over all pixels of a decoded grid
+
+struct Summary {
+    size_t pixels = 0;
+    size_t nodata = 0;
+    size_t clutter = 0;
+    size_t wet = 0;
+    float max = 0.0f;
+};
+
+Summary summarize(const Grid& g);
+
+// to string
+std::ostream& operator<<(std::ostream& os, const Summary& s);
@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRVH_X86 1
+#endif
+
+#include "batch.h"
+#include "cube.h"
+#include "logger.h"
+#include "payload.h"
+#include "products.h"
+#include "traits.h"
+
+using namespace std;
+
+
+/* KERNELS ------------------------------------------------------------------ */
+
+// All kernels reduce a block of n pixels of a STEP_MAJOR cube: `values` points
+// at the first pixel of the block in step 0, step s starts `stride` floats
+// later. toRate[s] converts the values of step s to mm/h. The outputs point at
+// the first pixel of the block. Pixels where no step has data (maxRate still
+// -inf at the end) become no data in every output, see `finishBlock`.
+//
+// The block is small enough that the outputs stay in L1 while the steps are
+// streamed through one after another.
+
+struct Block {
+    const float* values;
+    size_t stride;
+    size_t steps;
+    const float* toRate;
+    const float* thresholds;
+    size_t nt;
+    size_t n;
+
+    float* acc;
+    float* maxRate;
+    float* counts[MAX_THRESHOLDS];
+
+    uint8_t* accMask;
+    uint8_t* maxRateMask;
+    uint8_t* countsMask[MAX_THRESHOLDS];
+};
+
+static void finishBlock(const Block& b, size_t i0)
+{
+    // pixels without any data are no data in every product; all other masks
+    // are cleared, as the outputs may be reused
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float ninf = -std::numeric_limits<float>::infinity();
+
+    // NOTE: locals, since stores through uint8_t* may alias the fields of b
+    const size_t n = b.n - i0;
+    float* mx = b.maxRate + i0;
+    float* acc = b.acc + i0;
+    uint8_t* mask = b.accMask + i0;
+
+    for (size_t i = 0; i < n; i++)
+        mask[i] = (mx[i] == ninf) ? FLAG_NODATA : 0;
+
+    for (size_t i = 0; i < n; i++) {
+        acc[i] = mask[i] ? nan : acc[i];
+        mx[i] = mask[i] ? nan : mx[i];
+    }
+    std::memcpy(b.maxRateMask + i0, mask, n);
+
+    for (size_t t = 0; t < b.nt; t++)
+    {
+        float* counts = b.counts[t] + i0;
+        for (size_t i = 0; i < n; i++)
+            counts[i] = mask[i] ? nan : counts[i];
+        std::memcpy(b.countsMask[t] + i0, mask, n);
+    }
+}
+
+static void reduceScalar(const Block& b, size_t i0)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+
+    for (size_t i = i0; i < b.n; i++) {
+        b.acc[i] = 0.0f;
+        b.maxRate[i] = -inf;
+        for (size_t t = 0; t < b.nt; t++)
+            b.counts[t][i] = 0.0f;
+    }
+
+    for (size_t s = 0; s < b.steps; s++)
+    {
+        const float* v = b.values + s * b.stride;
+
+        for (size_t i = i0; i < b.n; i++)
+        {
+            // NaN (no data) fails every comparison, hence is skipped
+            if (v[i] != v[i])
+                continue;
+
+            float r = v[i] * b.toRate[s];
+            b.acc[i] += v[i];
+            b.maxRate[i] = std::max(b.maxRate[i], r);
+            for (size_t t = 0; t < b.nt; t++)
+                b.counts[t][i] += (r > b.thresholds[t]) ? 1.0f : 0.0f;
+        }
+    }
+
+    finishBlock(b, i0);
+}
+
+#ifdef PRVH_X86
+
+__attribute__((target("avx2")))
+static void reduceAVX2(const Block& b, size_t)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    const __m256 ninf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+    size_t i = 0;
+    for (; i + 8 <= b.n; i += 8) {
+        _mm256_storeu_ps(b.acc + i, zero);
+        _mm256_storeu_ps(b.maxRate + i, ninf);
+        for (size_t t = 0; t < b.nt; t++)
+            _mm256_storeu_ps(b.counts[t] + i, zero);
+    }
+
+    for (size_t s = 0; s < b.steps; s++)
+    {
+        const float* v = b.values + s * b.stride;
+        const __m256 toRate = _mm256_set1_ps(b.toRate[s]);
+
+        for (size_t k = 0; k < i; k += 8)
+        {
+            __m256 x = _mm256_loadu_ps(v + k);
+
+            // ordered compare: all ones unless x is NaN
+            __m256 valid = _mm256_cmp_ps(x, x, _CMP_ORD_Q);
+            __m256 r = _mm256_mul_ps(x, toRate);
+
+            _mm256_storeu_ps(b.acc + k, _mm256_add_ps(_mm256_loadu_ps(b.acc + k), _mm256_and_ps(x, valid)));
+
+            // max returns the second operand if the first is NaN
+            _mm256_storeu_ps(b.maxRate + k, _mm256_max_ps(r, _mm256_loadu_ps(b.maxRate + k)));
+
+            for (size_t t = 0; t < b.nt; t++) {
+                __m256 above = _mm256_cmp_ps(r, _mm256_set1_ps(b.thresholds[t]), _CMP_GT_OQ);
+                _mm256_storeu_ps(b.counts[t] + k, _mm256_add_ps(_mm256_loadu_ps(b.counts[t] + k), _mm256_and_ps(above, one)));
+            }
+        }
+    }
+
+    // no data where maxRate is still -inf, see finishBlock
+    const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const __m128i nodata = _mm_set1_epi8(FLAG_NODATA);
+
+    for (size_t k = 0; k < i; k += 8)
+    {
+        __m256 none = _mm256_cmp_ps(_mm256_loadu_ps(b.maxRate + k), ninf, _CMP_EQ_OQ);
+
+        _mm256_storeu_ps(b.acc + k, _mm256_blendv_ps(_mm256_loadu_ps(b.acc + k), nan, none));
+        _mm256_storeu_ps(b.maxRate + k, _mm256_blendv_ps(_mm256_loadu_ps(b.maxRate + k), nan, none));
+        for (size_t t = 0; t < b.nt; t++)
+            _mm256_storeu_ps(b.counts[t] + k, _mm256_blendv_ps(_mm256_loadu_ps(b.counts[t] + k), nan, none));
+
+        // 8 lanes of 0 / -1 → 8 bytes of 0 / FLAG_NODATA
+        __m256i n32 = _mm256_castps_si256(none);
+        __m128i n16 = _mm_packs_epi32(_mm256_castsi256_si128(n32), _mm256_extracti128_si256(n32, 1));
+        __m128i m = _mm_and_si128(_mm_packs_epi16(n16, n16), nodata);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(b.accMask + k), m);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(b.maxRateMask + k), m);
+        for (size_t t = 0; t < b.nt; t++)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(b.countsMask[t] + k), m);
+    }
+
+    // remainder of the block
+    reduceScalar(b, i);
+}
+
+#endif
+
+
+/* DISPATCH ----------------------------------------------------------------- */
+
+// typedef for a kernel function pointer; the second argument is the first
+// pixel of the block the kernel starts at
+using ReduceFunction = void (*)(const Block&, size_t);
+
+struct ReduceKernel {
+    const char* name;
+    ReduceFunction func;
+};
+
+static ReduceKernel selectKernel()
+{
+#ifdef PRVH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", reduceAVX2};
+#endif
+    return {"scalar", reduceScalar};
+}
+
+static const ReduceKernel& kernel()
+{
+    // NOTE: function-local static → selected once, thread-safe since C++11
+    static const ReduceKernel k = selectKernel();
+    return k;
+}
+
+const char* reduceKernel() { return kernel().name; }
+
+
+/* REDUCTION ---------------------------------------------------------------- */
+
+static void reducePixels(const Cube& c, const Block& b, size_t p0)
+{
+    // PIXEL_MAJOR: the series of each pixel is contiguous, hence one pixel at
+    // a time, over all of its steps
+    const float ninf = -std::numeric_limits<float>::infinity();
+    const size_t steps = size_t(c.getSteps());
+
+    for (size_t i = 0; i < b.n; i++)
+    {
+        const float* v = c.getValues() + (p0 + i) * steps;
+        float acc = 0.0f;
+        float mx = ninf;
+        float counts[MAX_THRESHOLDS] = {};
+
+        for (size_t s = 0; s < steps; s++)
+        {
+            if (v[s] != v[s])
+                continue;
+
+            float r = v[s] * b.toRate[s];
+            acc += v[s];
+            mx = std::max(mx, r);
+            for (size_t t = 0; t < b.nt; t++)
+                counts[t] += (r > b.thresholds[t]) ? 1.0f : 0.0f;
+        }
+
+        b.acc[i] = acc;
+        b.maxRate[i] = mx;
+        for (size_t t = 0; t < b.nt; t++)
+            b.counts[t][i] = counts[t];
+    }
+}
+
+
+static void prepare(Grid& g, int rows, int cols)
+{
+    // reuse the grid if it already has the right size
+    if (g.getRows() != rows || g.getCols() != cols)
+        g = Grid(rows, cols);
+}
+
+
+void reduceCube(const Cube& c, const std::vector<float>& thresholds, unsigned jobs, Products& out)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (c.getSteps() == 0)
+        throw std::invalid_argument("reduceCube: cube must contain at least one step!");
+    if (!isAmount(c.getPI()))
+        throw std::invalid_argument("reduceCube: product " + std::string(c.getPI()) + " holds no precipitation amounts!");
+    if (thresholds.size() > MAX_THRESHOLDS)
+        throw std::invalid_argument("reduceCube: at most " + std::to_string(MAX_THRESHOLDS) + " thresholds!");
+
+    const int rows = c.getRows();
+    const int cols = c.getCols();
+    const size_t pixels = size_t(rows) * cols;
+
+    prepare(out.accumulation, rows, cols);
+    prepare(out.maxRate, rows, cols);
+    out.thresholds = thresholds;
+    out.exceedances.resize(thresholds.size());
+    for (Grid& g : out.exceedances)
+        prepare(g, rows, cols);
+
+    // mm per interval → mm/h, from the interval of each step
+    std::vector<float> toRate;
+    for (const Header& h : c.getHeaders())
+        toRate.push_back(h.getIN() > 0 ? 60.0f / h.getIN() : 0.0f);
+
+    // blocks of pixels on the worker pool; 1024 pixels keep the accumulators
+    // of a block (4 kB each) in L1
+    const size_t BLOCK = 1024;
+    size_t blocks = (pixels + BLOCK - 1) / BLOCK;
+    ReduceFunction f = kernel().func;
+
+    parallelFor(blocks, jobs, [&](size_t k) {
+        size_t p0 = k * BLOCK;
+
+        Block b;
+        b.values = c.getValues() + p0;
+        b.stride = pixels;
+        b.steps = size_t(c.getSteps());
+        b.toRate = toRate.data();
+        b.thresholds = thresholds.data();
+        b.nt = thresholds.size();
+        b.n = std::min(BLOCK, pixels - p0);
+
+        b.acc = out.accumulation.getValues() + p0;
+        b.maxRate = out.maxRate.getValues() + p0;
+        b.accMask = out.accumulation.getMask() + p0;
+        b.maxRateMask = out.maxRate.getMask() + p0;
+        for (size_t t = 0; t < b.nt; t++) {
+            b.counts[t] = out.exceedances[t].getValues() + p0;
+            b.countsMask[t] = out.exceedances[t].getMask() + p0;
+        }
+
+        if (c.getLayout() == Layout::STEP_MAJOR)
+            f(b, 0);
+        else {
+            reducePixels(c, b, p0);
+            finishBlock(b, 0);
+        }
+    });
+
+    out.reduceTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_INFO("reduceCube: run " << c.getTS() << " with " << c.getSteps() << " steps and " << thresholds.size() << " thresholds in " << out.reduceTime << "s using " << kernel().name << " kernel");
+}
+
+
+Products reduceCube(const Cube& c, const std::vector<float>& thresholds, unsigned jobs)
+{
+    Products out;
+    reduceCube(c, thresholds, jobs, out);
+    return out;
+}
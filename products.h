@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "cube.h"
+#include "payload.h"
+
+
+/* PRODUCTS ----------------------------------------------------------------- */
+
+// Derived products of one run, reduced over all forecast steps per pixel.
+//
+// RV values are precipitation amounts in mm per interval of `IN` minutes, hence
+// the rate of a step in mm/h is value * 60 / IN, and the accumulation over the
+// run, i.e. the sum of rate * IN / 60, is the sum of the amounts.
+//
+// No-data steps are left out of every reduction; a pixel without data in any
+// step is no data (NaN, FLAG_NODATA) in all products.
+
+struct Products {
+    // mm over all steps
+    Grid accumulation;
+
+    // largest rate of any step in mm/h
+    Grid maxRate;
+
+    // rate thresholds in mm/h and, for each of them, the number of steps with
+    // a rate above the threshold
+    std::vector<float> thresholds;
+    std::vector<Grid> exceedances;
+
+    // wall time of the last `reduceCube` in seconds
+    double reduceTime = 0;
+};
+
+// at most this many thresholds per call
+const size_t MAX_THRESHOLDS = 16;
+
+// reduce all steps of the cube on `jobs` worker threads (0: one per core);
+// throws std::invalid_argument for an empty cube or too many thresholds
+Products reduceCube(const Cube& c, const std::vector<float>& thresholds, unsigned jobs);
+
+// same, into `out`; grids of the right size are reused, hence repeated
+// reductions of runs on the same grid do not allocate
+void reduceCube(const Cube& c, const std::vector<float>& thresholds, unsigned jobs, Products& out);
+
+// name of the kernel selected at runtime ("avx2" or "scalar")
+const char* reduceKernel();
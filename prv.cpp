@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string_view>
+
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "prv.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* STATUS ------------------------------------------------------------------- */
+
+const char* prv::statusName(Status s) noexcept
+{
+    switch (s)
+    {
+        case Status::OK: return "OK";
+        case Status::NO_ETX: return "NO_ETX";
+        case Status::MALFORMED: return "MALFORMED";
+        case Status::TRUNCATED: return "TRUNCATED";
+    }
+    return "UNKNOWN";
+}
+
+
+/* PARSING ------------------------------------------------------------------ */
+
+prv::Status prv::parseHeader(Bytes file, Header& h, Bytes& payload) noexcept
+{
+    const char* b = reinterpret_cast<const char*>(file.data);
+
+    long etxIndex = findETX(b, std::min(file.size, HEADER_MAX));
+    if (etxIndex < 0)
+        return Status::NO_ETX;
+
+    // NOTE: the setters throw only for malformed fields, i.e. the exception
+    // (and its message) is paid for on the error path alone
+    try {
+        ::parseHeader(std::string_view(b, etxIndex), h);
+    }
+    catch (const std::exception&) {
+        return Status::MALFORMED;
+    }
+
+    payload = Bytes(file.data + etxIndex + 1, file.size - size_t(etxIndex) - 1);
+    return Status::OK;
+}
+
+
+prv::Status prv::decodePayload(Bytes payload, const Header& h, float* values, uint8_t* mask) noexcept
+{
+    const size_t n = size_t(h.getRows()) * h.getCols();
+
+    // NOTE: a header from `parseHeader` always has a known product
+    size_t needed;
+    try {
+        needed = payloadBytes(h);
+    }
+    catch (const std::exception&) {
+        return Status::MALFORMED;
+    }
+
+    if (payload.size < needed)
+        return Status::TRUNCATED;
+
+    decodeProduct(h.getPI(), reinterpret_cast<const char*>(payload.data), n, h.getFactor(), values, mask);
+    return Status::OK;
+}
+
+
+/* LOGGING ------------------------------------------------------------------ */
+
+// NOTE: the library's backend for `Logger` (see logger.h) in place of
+// logger.cpp: records go to the installed handler, there is no log4cxx, no
+// file and no background thread
+
+static std::atomic<prv::LogHandler> handler{nullptr};
+static std::atomic<int> threshold{PRVH_LEVEL_OFF};
+
+void prv::setLogHandler(LogHandler h, int level) noexcept
+{
+    threshold.store(h ? level : PRVH_LEVEL_OFF, std::memory_order_relaxed);
+    handler.store(h, std::memory_order_release);
+}
+
+bool Logger::isEnabled(int level)
+{
+    return level >= threshold.load(std::memory_order_relaxed) && handler.load(std::memory_order_acquire) != nullptr;
+}
+
+void Logger::write(int level, const char* msg, size_t n)
+{
+    if (prv::LogHandler h = handler.load(std::memory_order_acquire))
+        h(level, msg, n);
+}
+
+// the handler decides how records are delivered
+void Logger::setAsync(bool) {}
+void Logger::flush() {}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "classes.h"
+
+/*
+ * libprv: the header parser and payload decoder of prvh as a library, for
+ * calling them in-process instead of running `prvh` per file. `make lib`
+ * builds libprv.a and libprv.so from utils.cpp, classes.cpp, payload.cpp and
+ * prv.cpp; log4cxx is not linked.
+ *
+ * On success, neither function allocates, throws or logs. Log records are
+ * only formatted once a handler is installed with `prv::setLogHandler`.
+ *
+ *  prv::Bytes file(data, size);
+ *  Header h;
+ *  prv::Bytes payload;
+ *  if (prv::parseHeader(file, h, payload) == prv::Status::OK)
+ *      prv::decodePayload(payload, h, values, mask);
+ */
+
+namespace prv {
+
+
+/* BYTES -------------------------------------------------------------------- */
+
+// read-only view of contiguous bytes; stands in for std::span<const std::byte>
+// (C++20), which converts to it, as does any container with data() and size()
+
+struct Bytes {
+    const std::byte* data = nullptr;
+    size_t size = 0;
+
+    constexpr Bytes() = default;
+    constexpr Bytes(const std::byte* d, size_t n) : data(d), size(n) {}
+    Bytes(const void* d, size_t n) : data(static_cast<const std::byte*>(d)), size(n) {}
+
+    template <class C, class = decltype(std::declval<const C&>().data() + std::declval<const C&>().size())>
+    Bytes(const C& c) : Bytes(static_cast<const void*>(c.data()), c.size() * sizeof(*c.data())) {}
+};
+
+
+/* STATUS ------------------------------------------------------------------- */
+
+//  NO_ETX     no ETX byte within the first HEADER_MAX bytes
+//  MALFORMED  the header does not parse
+//  TRUNCATED  fewer payload bytes than GP rows x cols x 2
+
+enum class Status { OK, NO_ETX, MALFORMED, TRUNCATED };
+
+// e.g. "TRUNCATED"
+const char* statusName(Status s) noexcept;
+
+
+/* PARSING ------------------------------------------------------------------ */
+
+// parse the ASCII header at the start of file into h (all fields but the file
+// name are reset first, so h may be reused); payload is set to the bytes after
+// the ETX byte (possibly fewer than GP demands, see decodePayload)
+Status parseHeader(Bytes file, Header& h, Bytes& payload) noexcept;
+
+// decode the rows x cols pixels of h at the start of payload, with the decoder
+// of its product (see traits.h), into values and mask, which must hold rows x
+// cols elements each (see payload.h for the FLAG_* bits of the mask)
+Status decodePayload(Bytes payload, const Header& h, float* values, uint8_t* mask) noexcept;
+
+
+/* LOGGING ------------------------------------------------------------------ */
+
+// receives every record at or above the level given to setLogHandler; level
+// is one of the PRVH_LEVEL_* constants of logger.h, msg is not terminated
+using LogHandler = void (*)(int level, const char* msg, size_t n);
+
+// install (or, with nullptr, remove) the handler; records below the level of
+// the build (`make lib LIB_LOG_LEVEL=...`, default ERROR) are compiled out
+void setLogHandler(LogHandler handler, int level) noexcept;
+
+}
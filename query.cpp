@@ -0,0 +1,81 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "query.h"
+#include "traits.h"
+
+using namespace std;
+
+
+/* QUERIES ------------------------------------------------------------------ */
+
+static void readWindow(const Result& r, int r0, int c0, int r1, int c1, Grid& g, std::vector<char>& buffer)
+{
+    // read and decode one window of one step; `buffer` is reused across calls
+    const Header& h = r.header;
+    size_t width = size_t(c1 - c0 + 1);
+    size_t bpp = bytesPerPixel(h.getPI());
+    buffer.resize(width * bpp);
+
+    int fd = ::open(std::string(h.getFN()).c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("unable to open file " + std::string(h.getFN()));
+
+    for (int row = r0; row <= r1; row++)
+    {
+        off_t offset = off_t(r.etxIndex) + 1 + off_t(bpp) * (off_t(row) * h.getCols() + c0);
+        ssize_t n = ::pread(fd, buffer.data(), buffer.size(), offset);
+
+        if (n != static_cast<ssize_t>(buffer.size())) {
+            ::close(fd);
+            throw std::invalid_argument("queryWindow: payload of " + std::string(h.getFN()) + " is incomplete!");
+        }
+
+        size_t k = size_t(row - r0) * width;
+        decodeProduct(h.getPI(), buffer.data(), width, h.getFactor(), g.getValues() + k, g.getMask() + k);
+    }
+
+    ::close(fd);
+}
+
+
+std::vector<Grid> queryWindow(const std::vector<Result>& run, int r0, int c0, int r1, int c1)
+{
+    std::vector<Grid> grids;
+    std::vector<char> buffer;
+
+    for (const Result& r : run)
+    {
+        const Header& h = r.header;
+
+        if (r.etxIndex < 0)
+            throw std::invalid_argument("queryWindow: no ETX byte in " + std::string(h.getFN()) + "!");
+
+        if (r0 < 0 || c0 < 0 || r0 > r1 || c0 > c1 || r1 >= h.getRows() || c1 >= h.getCols())
+        {
+            std::string msg = "queryWindow: window must lie within " + std::to_string(h.getRows()) + "x" + std::to_string(h.getCols()) + "!";
+            throw std::invalid_argument(msg);
+        }
+
+        grids.emplace_back(r1 - r0 + 1, c1 - c0 + 1);
+        readWindow(r, r0, c0, r1, c1, grids.back(), buffer);
+    }
+
+    LOG_INFO("queryWindow: [" << r0 << "," << c0 << "]-[" << r1 << "," << c1 << "] of " << run.size() << " steps");
+
+    return grids;
+}
+
+
+std::vector<Grid> queryPoint(const std::vector<Result>& run, int row, int col)
+{
+    return queryWindow(run, row, col, row, col);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include "batch.h"
+#include "payload.h"
+
+
+/* QUERIES ------------------------------------------------------------------ */
+
+// Random access into the payload without decoding whole grids: pixel (row, col)
+// is the 2-byte word at offset `etxIndex + 1 + 2 * (row * cols + col)`, hence a
+// window needs one pread of (c1 - c0 + 1) words per row and step.
+//
+// NOTE: rows and columns count from the first word after ETX, i.e. in storage
+// order of the file (row 0 is the southernmost row of the DWD grid).
+
+// decode rows r0..r1 and cols c0..c1 (inclusive) of every step of a run; the
+// result holds one (r1 - r0 + 1) x (c1 - c0 + 1) grid per step, ordered by VV
+std::vector<Grid> queryWindow(const std::vector<Result>& run, int r0, int c0, int r1, int c1);
+
+// decode pixel (row, col) of every step of a run as 1x1 grids
+std::vector<Grid> queryPoint(const std::vector<Result>& run, int row, int col);
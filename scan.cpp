@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "batch.h"
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "scan.h"
+#include "stats.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* BACKENDS ----------------------------------------------------------------- */
+
+IoBackend parseIoBackend(std::string_view s)
+{
+    if (s == "mmap")
+        return IoBackend::MMAP;
+    if (s == "pread")
+        return IoBackend::PREAD;
+    if (s == "uring")
+        return IoBackend::URING;
+
+    throw std::invalid_argument("parseIoBackend: unknown backend '" + std::string(s) + "'!");
+}
+
+const char* ioBackendName(IoBackend b)
+{
+    switch (b)
+    {
+        case IoBackend::MMAP: return "mmap";
+        case IoBackend::PREAD: return "pread";
+        case IoBackend::URING: return "uring";
+    }
+    return "unknown";
+}
+
+
+/* IO_URING ----------------------------------------------------------------- */
+
+// NOTE: talks to the kernel through the raw system calls and the ring layout of
+// <linux/io_uring.h>, hence there is no dependency on liburing. IORING_OP_READV
+// is the oldest read operation (5.1); the ring is the only writer of the
+// submission tail and the only reader of the completion head, everything the
+// kernel writes is read with acquire and everything it reads is published
+// with release semantics.
+
+#ifdef __linux__
+
+static unsigned loadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void storeRelease(unsigned* p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+static void* offsetOf(void* base, size_t off) { return static_cast<char*>(base) + off; }
+
+ReadRing::ReadRing(unsigned n) : ringFd(-1), entries(0), sq(MAP_FAILED), sqLen(0), cq(MAP_FAILED), cqLen(0), sqes(MAP_FAILED), sqesLen(0)
+{
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+
+    ringFd = int(::syscall(__NR_io_uring_setup, n, &p));
+    if (ringFd < 0)
+        throw std::runtime_error("ReadRing: io_uring_setup failed: " + std::string(std::strerror(errno)));
+
+    entries = p.sq_entries;
+    sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    // since 5.4 both rings share one mapping
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+        sqLen = cqLen = std::max(sqLen, cqLen);
+
+    sq = ::mmap(nullptr, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cq = single ? sq : ::mmap(nullptr, cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqes = ::mmap(nullptr, sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        release();
+        throw std::runtime_error("ReadRing: unable to map the rings");
+    }
+
+    sqHead = static_cast<unsigned*>(offsetOf(sq, p.sq_off.head));
+    sqTail = static_cast<unsigned*>(offsetOf(sq, p.sq_off.tail));
+    sqMask = *static_cast<unsigned*>(offsetOf(sq, p.sq_off.ring_mask));
+    sqArray = static_cast<unsigned*>(offsetOf(sq, p.sq_off.array));
+    cqHead = static_cast<unsigned*>(offsetOf(cq, p.cq_off.head));
+    cqTail = static_cast<unsigned*>(offsetOf(cq, p.cq_off.tail));
+    cqMask = *static_cast<unsigned*>(offsetOf(cq, p.cq_off.ring_mask));
+    cqes = offsetOf(cq, p.cq_off.cqes);
+}
+
+ReadRing::~ReadRing() { release(); }
+
+void ReadRing::release()
+{
+    if (sqes != MAP_FAILED)
+        ::munmap(sqes, sqesLen);
+    if (cq != MAP_FAILED && cq != sq)
+        ::munmap(cq, cqLen);
+    if (sq != MAP_FAILED)
+        ::munmap(sq, sqLen);
+    if (ringFd >= 0)
+        ::close(ringFd);
+
+    sq = cq = sqes = MAP_FAILED;
+    ringFd = -1;
+}
+
+void ReadRing::read(std::vector<ReadRequest>& reqs)
+{
+    const size_t n = reqs.size();
+    std::vector<struct iovec> iov(n);
+
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes);
+    struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>(cqes);
+
+    size_t next = 0;
+    size_t done = 0;
+    unsigned inflight = 0;
+
+    while (done < n)
+    {
+        // queue as many reads as there is room for
+        unsigned tail = *sqTail;
+        unsigned head = loadAcquire(sqHead);
+
+        for (; next < n && inflight < entries && tail - head < entries; next++, tail++, inflight++)
+        {
+            ReadRequest& r = reqs[next];
+            iov[next].iov_base = r.buf;
+            iov[next].iov_len = r.len;
+
+            unsigned k = tail & sqMask;
+            std::memset(&sqe[k], 0, sizeof(sqe[k]));
+            sqe[k].opcode = IORING_OP_READV;
+            sqe[k].fd = r.fd;
+            sqe[k].addr = reinterpret_cast<uint64_t>(&iov[next]);
+            sqe[k].len = 1;
+            sqe[k].off = uint64_t(r.offset);
+            sqe[k].user_data = next;
+            sqArray[k] = k;
+        }
+        storeRelease(sqTail, tail);
+
+        // submit them (and any left over from an interrupted call) and wait for
+        // at least one completion in the same call
+        unsigned unsubmitted = tail - loadAcquire(sqHead);
+        if (::syscall(__NR_io_uring_enter, ringFd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            throw std::runtime_error("ReadRing: io_uring_enter failed: " + std::string(std::strerror(errno)));
+
+        unsigned chead = *cqHead;
+        unsigned ctail = loadAcquire(cqTail);
+
+        for (; chead != ctail; chead++, done++, inflight--) {
+            const struct io_uring_cqe& c = cqe[chead & cqMask];
+            reqs[c.user_data].result = c.res;
+        }
+        storeRelease(cqHead, chead);
+    }
+}
+
+#else
+
+ReadRing::ReadRing(unsigned) : ringFd(-1), entries(0), sq(nullptr), sqLen(0), cq(nullptr), cqLen(0), sqes(nullptr), sqesLen(0)
+{
+    throw std::runtime_error("ReadRing: io_uring requires Linux");
+}
+
+ReadRing::~ReadRing() {}
+
+void ReadRing::release() {}
+
+void ReadRing::read(std::vector<ReadRequest>&) {}
+
+#endif
+
+
+bool uringAvailable()
+{
+    // probed once: a seccomp filter or `kernel.io_uring_disabled` makes
+    // io_uring_setup fail on kernels that have it
+    static const bool available = []() {
+        try {
+            ReadRing ring(1);
+            return true;
+        }
+        catch (const std::runtime_error& e) {
+            LOG_WARN("uringAvailable: " << e.what() << ", falling back to pread");
+            return false;
+        }
+    }();
+    return available;
+}
+
+
+/* READS -------------------------------------------------------------------- */
+
+void readAll(std::vector<ReadRequest>& reqs, IoBackend b, unsigned jobs)
+{
+    if (b == IoBackend::URING && uringAvailable()) {
+        // one ring per thread, kept for the next batch
+        thread_local ReadRing ring(SCAN_DEPTH);
+        ring.read(reqs);
+        return;
+    }
+
+    parallelFor(reqs.size(), jobs, [&](size_t k) {
+        ReadRequest& r = reqs[k];
+        ssize_t n;
+        do {
+            n = ::pread(r.fd, r.buf, r.len, r.offset);
+        } while (n < 0 && errno == EINTR);
+        r.result = n < 0 ? -errno : n;
+    });
+}
+
+
+/* SCAN --------------------------------------------------------------------- */
+
+// files per round when payloads are read, too: 16 payloads of 2.6 MB each
+const size_t DECODE_ROUND = 16;
+
+std::vector<Result> scanBatch(const std::vector<std::string>& files, bool decode, IoBackend b, unsigned jobs)
+{
+    if (b == IoBackend::MMAP)
+        return processBatch(files, decode, jobs);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Result> results(files.size());
+    const size_t round = decode ? DECODE_ROUND : SCAN_DEPTH;
+
+    // buffers are reused from round to round
+    std::vector<char> headers(round * HEADER_MAX);
+    std::vector<std::vector<char>> payloads(decode ? round : 0);
+    std::vector<int> fds(round);
+    std::vector<ReadRequest> reqs;
+    std::vector<size_t> pending;
+
+    for (size_t first = 0; first < files.size(); first += round)
+    {
+        const size_t m = std::min(round, files.size() - first);
+
+        // open all files of the round, then read all header prefixes at once;
+        // pending[i] is the file (within the round) of reqs[i]
+        reqs.clear();
+        pending.clear();
+        for (size_t k = 0; k < m; k++)
+        {
+            Result& r = results[first + k];
+            r.header.setFN(files[first + k]);
+            Stats::add(Counter::FILES);
+
+            StageTimer open(Stage::OPEN);
+            fds[k] = ::open(files[first + k].c_str(), O_RDONLY | O_CLOEXEC);
+            open.stop();
+
+            if (fds[k] < 0) {
+                LOG_ERROR("scanBatch: unable to open file " << files[first + k]);
+                r.error = "Could not open file " + files[first + k];
+                Stats::add(Counter::ERRORS);
+                continue;
+            }
+
+            ReadRequest q;
+            q.fd = fds[k];
+            q.buf = headers.data() + k * HEADER_MAX;
+            q.len = HEADER_MAX;
+            q.offset = 0;
+            reqs.push_back(q);
+            pending.push_back(k);
+        }
+
+        readAll(reqs, b, jobs);
+
+        // parse the prefixes; collect payload reads for the files that parse
+        std::vector<ReadRequest> payloadReqs(reqs.size());
+
+        parallelFor(reqs.size(), jobs, [&](size_t i) {
+            const size_t k = pending[i];
+            const ReadRequest& q = reqs[i];
+            Result& r = results[first + k];
+
+            try {
+                if (q.result < 0)
+                    throw std::runtime_error("unable to read file " + files[first + k]);
+
+                StageTimer etx(Stage::ETX);
+                long etxIndex = findETX(q.buf, size_t(q.result));
+                etx.stop();
+                if (etxIndex < 0)
+                    throw std::invalid_argument("no ETX byte in " + files[first + k]);
+
+                StageTimer parse(Stage::PARSE);
+                parseHeader(std::string_view(q.buf, etxIndex), r.header);
+                parse.stop();
+                r.etxIndex = etxIndex;
+                Stats::add(Counter::BYTES_READ, size_t(q.result));
+
+                if (decode) {
+                    std::vector<char>& p = payloads[k];
+                    p.resize(payloadBytes(r.header));
+
+                    ReadRequest& pq = payloadReqs[i];
+                    pq.fd = q.fd;
+                    pq.buf = p.data();
+                    pq.len = p.size();
+                    pq.offset = etxIndex + 1;
+                }
+            }
+            catch (const std::runtime_error& e) {
+                LOG_ERROR("scanBatch: " << e.what());
+                r.error = "Could not open file " + files[first + k];
+                Stats::add(Counter::ERRORS);
+            }
+            catch (const std::exception& e) {
+                LOG_ERROR("scanBatch: " << e.what());
+                r.error = "Could not parse file " + files[first + k] + ": " + e.what();
+                Stats::add(Counter::ERRORS);
+            }
+        });
+
+        if (decode)
+        {
+            // payloads of all parsed files in one batch, then decode them
+            std::vector<ReadRequest> payloadBatch;
+            std::vector<size_t> owners;
+            for (size_t i = 0; i < payloadReqs.size(); i++) {
+                if (payloadReqs[i].fd >= 0) {
+                    payloadBatch.push_back(payloadReqs[i]);
+                    owners.push_back(pending[i]);
+                }
+            }
+
+            readAll(payloadBatch, b, jobs);
+
+            parallelFor(payloadBatch.size(), jobs, [&](size_t i) {
+                const size_t k = owners[i];
+                const ReadRequest& q = payloadBatch[i];
+                Result& r = results[first + k];
+
+                if (q.result != ssize_t(q.len)) {
+                    std::string msg = "decodeGrid: payload must be of size " + std::to_string(q.len) + "!";
+                    LOG_ERROR("scanBatch: " << msg);
+                    r.error = "Could not parse file " + files[first + k] + ": " + msg;
+                    Stats::add(Counter::ERRORS);
+                    return;
+                }
+                Stats::add(Counter::BYTES_READ, q.len);
+
+                StageTimer decoding(Stage::DECODE);
+                Grid g(r.header.getRows(), r.header.getCols());
+                decodeProduct(r.header.getPI(), q.buf, g.getSize(), r.header.getFactor(), g.getValues(), g.getMask());
+                decoding.stop();
+
+                StageTimer summary(Stage::SUMMARIZE);
+                r.summary = summarize(g);
+                r.decoded = true;
+            });
+        }
+
+        for (size_t k = 0; k < m; k++)
+            if (fds[k] >= 0)
+                ::close(fds[k]);
+    }
+
+    [[maybe_unused]] double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("scanBatch: " << files.size() << " files with " << ioBackendName(b) << " in " << s << "s (" << (s > 0 ? files.size() / s : 0) << " files/s)");
+
+    sortResults(results);
+
+    return results;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "batch.h"
+
+
+/* BACKENDS ----------------------------------------------------------------- */
+
+// how `scanBatch` reads files
+//  MMAP   map each file, as `processFile` does
+//  PREAD  one pread per header prefix and payload, on the worker threads
+//  URING  io_uring: up to SCAN_DEPTH reads in flight from a single thread,
+//         submitted and reaped with one system call per round (Linux >= 5.1;
+//         falls back to PREAD where the ring cannot be set up)
+
+enum class IoBackend { MMAP, PREAD, URING };
+
+// "mmap", "pread" or "uring"; throws std::invalid_argument otherwise
+IoBackend parseIoBackend(std::string_view s);
+const char* ioBackendName(IoBackend b);
+
+// reads in flight with URING, and files per round of `scanBatch`
+const unsigned SCAN_DEPTH = 256;
+
+
+/* READS -------------------------------------------------------------------- */
+
+// one positional read of up to len bytes of fd at offset into buf; result is
+// the number of bytes read or -errno
+
+struct ReadRequest {
+    int fd = -1;
+    char* buf = nullptr;
+    size_t len = 0;
+    off_t offset = 0;
+    ssize_t result = 0;
+};
+
+// Submission and completion rings of one io_uring instance, mapped into this
+// process. Owned by one thread at a time.
+
+class ReadRing {
+private:
+    int ringFd;
+    unsigned entries;
+
+    // mappings of the rings and the submission entries
+    void* sq;
+    size_t sqLen;
+    void* cq;
+    size_t cqLen;
+    void* sqes;
+    size_t sqesLen;
+
+    // pointers into the mappings
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    void* cqes;
+
+    // unmap and close whatever is set up
+    void release();
+
+public:
+    // throws std::runtime_error if io_uring is not available
+    explicit ReadRing(unsigned entries);
+    ~ReadRing();
+
+    ReadRing(const ReadRing&) = delete;
+    void operator=(const ReadRing&) = delete;
+
+    // perform all reads, with up to `entries` in flight at any time
+    void read(std::vector<ReadRequest>& reqs);
+};
+
+// true if this kernel (and seccomp policy) allows io_uring
+bool uringAvailable();
+
+// perform all reads with PREAD (on `jobs` worker threads, 0: one per core) or
+// URING; results are stored in the requests
+void readAll(std::vector<ReadRequest>& reqs, IoBackend b, unsigned jobs);
+
+
+/* SCAN --------------------------------------------------------------------- */
+
+// Same results as `processBatch`, but with batched reads for large archive
+// scans: files are opened SCAN_DEPTH at a time, their header prefixes (and,
+// with decode, payloads) read in one batch each, then parsed and decoded on
+// `jobs` worker threads. MMAP is `processBatch` itself.
+std::vector<Result> scanBatch(const std::vector<std::string>& files, bool decode, IoBackend b, unsigned jobs);
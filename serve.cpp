@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "cube.h"
+#include "logger.h"
+#include "output.h"
+#include "payload.h"
+#include "serve.h"
+#include "zones.h"
+
+using namespace std;
+
+
+/* SNAPSHOT ----------------------------------------------------------------- */
+
+Snapshot::Snapshot(const std::vector<Result>& results, const std::string& regionsPath, unsigned jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (const std::vector<Result>& run : groupRuns(results))
+        cubes.push_back(loadCube(run, Layout::STEP_MAJOR, jobs));
+
+    regionsOf.assign(cubes.size(), -1);
+    stats.resize(cubes.size());
+
+    // runs whose grid the regions do not fit, or without precipitation
+    // amounts (RX), are served without statistics
+    for (size_t i = 0; i < cubes.size() && !regionsPath.empty(); i++) {
+        const Cube& c = cubes[i];
+        try {
+            size_t k = regionsFor(regions, regionsPath, c.getRows(), c.getCols());
+            stats[i] = zonalStats(c, regions[k], jobs);
+            regionsOf[i] = long(k);
+        }
+        catch (const std::exception& e) {
+            warnings.push_back("Snapshot: no regions for run " + std::string(c.getPI()) + std::string(c.getTS()) + ": " + e.what());
+            LOG_WARN(warnings.back());
+        }
+    }
+
+    [[maybe_unused]] double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Snapshot: " << cubes.size() << " runs, " << regions.size() << " region grids in " << s << "s");
+}
+
+const std::vector<Cube>& Snapshot::getCubes() const { return cubes; }
+const std::vector<std::string>& Snapshot::getWarnings() const { return warnings; }
+
+const Cube* Snapshot::find(std::string_view run) const
+{
+    if (run.size() < 2)
+        return nullptr;
+
+    const std::string_view pi = run.substr(0, 2);
+    const std::string_view ts = run.substr(2);
+
+    // cubes are ordered by PI, then TS: the last one of PI is the latest
+    const Cube* found = nullptr;
+    for (const Cube& c : cubes)
+        if (c.getPI() == pi && (ts == "latest" || c.getTS() == ts))
+            found = &c;
+    return found;
+}
+
+long Snapshot::findRegion(const Cube& c, uint32_t id) const
+{
+    long r = regionsOf[size_t(&c - cubes.data())];
+    if (r < 0)
+        return -1;
+    const RegionIndex& index = regions[size_t(r)];
+
+    // IDs are ascending
+    size_t lo = 0, hi = index.getRegions();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (index.getId(mid) < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < index.getRegions() && index.getId(lo) == id ? long(lo) : -1;
+}
+
+const ZoneStats* Snapshot::getStats(const Cube& c, size_t k) const
+{
+    size_t i = size_t(&c - cubes.data());
+    if (regionsOf[i] < 0)
+        return nullptr;
+    return stats[i].data() + k * size_t(c.getSteps());
+}
+
+
+/* PROTOCOL ----------------------------------------------------------------- */
+
+// split line at spaces into at most n words; returns the number of words
+static size_t split(std::string_view line, std::string_view* words, size_t n)
+{
+    size_t k = 0;
+    while (k < n) {
+        size_t b = line.find_first_not_of(' ');
+        if (b == std::string_view::npos)
+            break;
+        line.remove_prefix(b);
+        size_t e = std::min(line.find(' '), line.size());
+        words[k++] = line.substr(0, e);
+        line.remove_prefix(e);
+    }
+    return line.find_first_not_of(' ') == std::string_view::npos ? k : n + 1;
+}
+
+static bool toLong(std::string_view s, long& v)
+{
+    auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    return ec == std::errc() && p == s.data() + s.size();
+}
+
+static void putVV(Writer& w, int vv)
+{
+    // 3 digits, as in the file names
+    char b[3] = {char('0' + vv / 100 % 10), char('0' + vv / 10 % 10), char('0' + vv % 10)};
+    w.put(std::string_view(b, 3));
+}
+
+static void error(Writer& w, std::string_view msg)
+{
+    w.put("ERR ");
+    w.put(msg);
+    w.put('\n');
+}
+
+void answerRequest(const Snapshot& s, std::string_view line, Writer& w)
+{
+    std::string_view words[4];
+    size_t n = split(line, words, 4);
+
+    if (n == 0 || n > 4)
+        return error(w, "malformed request");
+
+    const std::string_view cmd = words[0];
+
+    if (cmd == "RUNS" && n == 1) {
+        w.put("OK");
+        for (const Cube& c : s.getCubes()) {
+            w.put(' ');
+            w.put(c.getPI());
+            w.put(c.getTS());
+        }
+        w.put('\n');
+        return;
+    }
+
+    if (n < 2)
+        return error(w, "malformed request");
+
+    const Cube* c = s.find(words[1]);
+    if (c == nullptr)
+        return error(w, "unknown run");
+
+    const std::vector<Header>& headers = c->getHeaders();
+
+    if (cmd == "HEADER" && n == 3) {
+        long vv;
+        if (!toLong(words[2], vv))
+            return error(w, "malformed VV");
+
+        for (const Header& h : headers) {
+            if (h.getVV() == vv) {
+                w.put("OK ");
+                writeRecord(w, h, Format::JSONL);
+                return;
+            }
+        }
+        return error(w, "unknown step");
+    }
+
+    if (cmd == "POINT" && n == 4) {
+        long row, col;
+        if (!toLong(words[2], row) || !toLong(words[3], col))
+            return error(w, "malformed row or column");
+        if (row < 0 || row >= c->getRows() || col < 0 || col >= c->getCols())
+            return error(w, "pixel outside the grid");
+
+        w.put("OK");
+        for (int step = 0; step < c->getSteps(); step++) {
+            size_t k = c->index(step, int(row), int(col));
+            w.put(' ');
+            putVV(w, headers[step].getVV());
+            w.put(':');
+            if (c->getMask()[k] & FLAG_NODATA)
+                w.put('-');
+            else
+                w.putFixed(c->getValues()[k], 2);
+        }
+        w.put('\n');
+        return;
+    }
+
+    if (cmd == "REGION" && n == 3) {
+        long id;
+        if (!toLong(words[2], id) || id < 0)
+            return error(w, "malformed region");
+
+        if (s.getStats(*c, 0) == nullptr)
+            return error(w, "no regions for run");
+
+        long k = s.findRegion(*c, uint32_t(id));
+        const ZoneStats* z = k < 0 ? nullptr : s.getStats(*c, size_t(k));
+        if (z == nullptr)
+            return error(w, "unknown region");
+
+        w.put("OK");
+        for (int step = 0; step < c->getSteps(); step++, z++) {
+            w.put(' ');
+            putVV(w, headers[step].getVV());
+            w.put(':');
+            w.putInt(z->valid);     w.put(',');
+            w.putInt(z->wet);       w.put(',');
+            w.putFixed(z->coverage(), 3, "-");
+            w.put(',');
+            w.putFixed(z->sum, 2);
+            w.put(',');
+            w.putFixed(z->mean(), 2, "-");
+            w.put(',');
+            w.putFixed(z->valid ? z->max : 0.0f, 2);
+        }
+        w.put('\n');
+        return;
+    }
+
+    error(w, "unknown request");
+}
+
+
+/* SERVER ------------------------------------------------------------------- */
+
+static std::atomic<bool> stopped{false};
+
+static void onSignal(int) { stopped = true; }
+
+// longest request line; longer lines close the connection
+const size_t REQUEST_MAX = 1024;
+
+// how long a worker waits for the next request of the client it just answered
+// before handing the connection back to the poll; saves two thread switches per
+// request of a busy client, and bounds how long other clients wait for a worker
+const int LINGER_MS = 1;
+
+// one client: its unanswered bytes and its buffered answers
+struct Connection {
+    int fd;
+    size_t used = 0;
+    char buffer[REQUEST_MAX];
+    Writer out;
+
+    explicit Connection(int fd) : fd(fd), out(fd, 1 << 14) {}
+    ~Connection()
+    {
+        try {
+            out.flush();
+        }
+        catch (const std::exception&) {}
+        ::close(fd);
+    }
+};
+
+static bool serveRequests(const Snapshot& s, Connection& c)
+{
+    // one read of a readable connection, then answer every complete line and
+    // send all answers at once; false once the connection is to be closed
+    try {
+        ssize_t n = ::read(c.fd, c.buffer + c.used, sizeof(c.buffer) - c.used);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            return true;
+        if (n <= 0)
+            return false;
+        c.used += size_t(n);
+
+        size_t begin = 0;
+        for (size_t e; (e = std::string_view(c.buffer + begin, c.used - begin).find('\n')) != std::string_view::npos; begin += e + 1) {
+            std::string_view line(c.buffer + begin, e);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            answerRequest(s, line, c.out);
+        }
+        c.out.flush();
+
+        std::memmove(c.buffer, c.buffer + begin, c.used - begin);
+        c.used -= begin;
+
+        if (c.used == sizeof(c.buffer)) {
+            error(c.out, "request too long");
+            return false;
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        // e.g. the client went away
+        LOG_WARN("serve: " << e.what());
+        return false;
+    }
+}
+
+void serveSocket(const Snapshot& s, const std::string& path, unsigned jobs)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("serve: socket path " + path + " is too long!");
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    // a socket file left behind by an earlier server; anything else is kept
+    struct stat st;
+    if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        ::unlink(path.c_str());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw std::runtime_error("serve: unable to create a socket");
+
+    if (::bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        ::close(listener);
+        throw std::runtime_error("serve: unable to listen on " + path);
+    }
+
+    stopped = false;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    // clients that hang up early must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Idle connections are polled here, together with the listener; a
+    // readable one waits in `pending` for the next free worker, which answers
+    // what it has read and hands it back through `returned`. Hence a worker is
+    // only busy while there are requests, and any number of clients may stay
+    // connected. Workers write to `wake` to interrupt the poll.
+    std::vector<std::unique_ptr<Connection>> idle;
+    std::deque<std::unique_ptr<Connection>> pending;
+    std::vector<std::unique_ptr<Connection>> returned;
+    std::mutex lock;
+    std::condition_variable ready;
+
+    int wake[2];
+    if (::pipe(wake) != 0) {
+        ::close(listener);
+        throw std::runtime_error("serve: unable to create a pipe");
+    }
+    for (int fd : wake)
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < workerCount(jobs, SIZE_MAX); t++)
+        pool.emplace_back([&]() {
+            for (;;) {
+                std::unique_ptr<Connection> c;
+                {
+                    std::unique_lock<std::mutex> l(lock);
+                    ready.wait(l, [&]() { return stopped || !pending.empty(); });
+                    if (pending.empty())
+                        return;
+                    c = std::move(pending.front());
+                    pending.pop_front();
+                }
+
+                // keep answering a busy client while nobody else waits, for
+                // at most LINGER_MS between its requests; closed connections
+                // are simply dropped
+                bool open;
+                for (;;) {
+                    open = serveRequests(s, *c);
+                    if (!open || stopped)
+                        break;
+                    {
+                        std::lock_guard<std::mutex> l(lock);
+                        if (!pending.empty())
+                            break;
+                    }
+                    struct pollfd p = {c->fd, POLLIN, 0};
+                    if (::poll(&p, 1, LINGER_MS) <= 0)
+                        break;
+                }
+                if (!open)
+                    continue;
+
+                {
+                    std::lock_guard<std::mutex> l(lock);
+                    returned.push_back(std::move(c));
+                }
+                // NOTE: a full pipe already holds a wake-up, hence errors are ignored
+                [[maybe_unused]] ssize_t n = ::write(wake[1], "", 1);
+            }
+        });
+
+    LOG_INFO("serve: listening on " << path << " with " << pool.size() << " workers");
+
+    std::vector<struct pollfd> fds;
+    while (!stopped)
+    {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            for (auto& c : returned)
+                idle.push_back(std::move(c));
+            returned.clear();
+        }
+
+        // wake up regularly to check for signals
+        fds.assign({{listener, POLLIN, 0}, {wake[0], POLLIN, 0}});
+        for (const auto& c : idle)
+            fds.push_back({c->fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), 500) <= 0)
+            continue;
+
+        char drain[64];
+        while (::read(wake[0], drain, sizeof(drain)) > 0) {}
+
+        // readable, hung up or failed: the worker's read tells which
+        size_t kept = 0;
+        {
+            std::lock_guard<std::mutex> l(lock);
+            for (size_t k = 0; k < idle.size(); k++) {
+                if (fds[k+2].revents)
+                    pending.push_back(std::move(idle[k]));
+                else
+                    idle[kept++] = std::move(idle[k]);
+            }
+        }
+        if (kept < idle.size()) {
+            idle.resize(kept);
+            ready.notify_all();
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd >= 0)
+                idle.push_back(std::make_unique<Connection>(fd));
+        }
+    }
+
+    ::close(listener);
+    ::unlink(path.c_str());
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        pending.clear();
+    }
+    ready.notify_all();
+    for (auto& t : pool)
+        t.join();
+
+    idle.clear();
+    returned.clear();
+    ::close(wake[0]);
+    ::close(wake[1]);
+
+    LOG_INFO("serve: stopped");
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.h"
+#include "cube.h"
+#include "output.h"
+#include "zones.h"
+
+
+/* SNAPSHOT ----------------------------------------------------------------- */
+
+// Everything a server answers from, loaded once: one step-major cube per run
+// and, if regions are given, the zonal statistics of every run. Read-only
+// after construction, hence shared by all connections without locking.
+// A run is identified by `<PI><TS>`, e.g. "RV2108242045", as products of
+// one time stamp are separate runs (see `groupRuns`).
+
+class Snapshot {
+private:
+    // ordered by PI, then TS
+    std::vector<Cube> cubes;
+
+    // one index per grid among the runs, all from the same file
+    std::vector<RegionIndex> regions;
+
+    // per cube, the index of its grid's regions (-1: no statistics) and the
+    // statistics, region-major as returned by `zonalStats`
+    std::vector<long> regionsOf;
+    std::vector<std::vector<ZoneStats>> stats;
+
+    // why runs have no statistics, e.g. regions that do not fit their grid
+    std::vector<std::string> warnings;
+
+public:
+    // decode all runs (see `groupRuns`) on `jobs` worker threads (0: one per
+    // core); regions are loaded from regionsPath unless it is empty
+    Snapshot(const std::vector<Result>& results, const std::string& regionsPath, unsigned jobs);
+
+    const std::vector<Cube>& getCubes() const;
+    const std::vector<std::string>& getWarnings() const;
+
+    // cube of run `<PI><TS>` (TS "latest": the last run of PI), or nullptr
+    const Cube* find(std::string_view run) const;
+
+    // index k of region id on the grid of cube c, or -1
+    long findRegion(const Cube& c, uint32_t id) const;
+
+    // stats of region k in every step of cube c, or nullptr without regions
+    const ZoneStats* getStats(const Cube& c, size_t k) const;
+};
+
+
+/* PROTOCOL ----------------------------------------------------------------- */
+
+// One request per line, one response line per request, either `OK ...` or
+// `ERR <message>`. A run is `<PI><TS>`, where TS may be `latest`.
+//
+//  RUNS                     OK <PI><TS> ...
+//  HEADER <run> <VV>        OK <header as a JSON object, see output.h>
+//  POINT <run> <row> <col>  OK <VV>:<value> ...           ("-" for no data)
+//  REGION <run> <id>        OK <VV>:<valid>,<wet>,<coverage>,<sum>,<mean>,<max> ...
+//
+// Rows and columns count in storage order, as for `--at`.
+
+// answer one request line (without the newline) into w
+void answerRequest(const Snapshot& s, std::string_view line, Writer& w);
+
+
+/* SERVER ------------------------------------------------------------------- */
+
+// Listen on the Unix domain socket at path (replacing a stale socket file) and
+// answer requests on `jobs` worker threads (0: one per core). Idle connections
+// are polled by the calling thread and occupy no worker; requests of one
+// connection are answered in order.
+// Runs until SIGINT or SIGTERM, then removes the socket file.
+void serveSocket(const Snapshot& s, const std::string& path, unsigned jobs);
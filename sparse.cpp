@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "sparse.h"
+#include "traits.h"
+
+using namespace std;
+
+
+/* SPARSE GRID -------------------------------------------------------------- */
+
+// constructor A and B
+SparseGrid::SparseGrid() : rows(0), cols(0), offsets(1, 0) {}
+
+SparseGrid::SparseGrid(int r, int c) : rows(r), cols(c), offsets(size_t(r) + 1, 0), nodata((size_t(r) * c + 63) / 64)
+{
+    if (c > 0x10000)
+        throw std::invalid_argument("SparseGrid: at most 65536 columns, got " + std::to_string(c) + "!");
+}
+
+// destructor: for now empty, as vectors clean up after themselves
+SparseGrid::~SparseGrid() {}
+
+const int SparseGrid::getRows() const { return rows; }
+const int SparseGrid::getCols() const { return cols; }
+const size_t SparseGrid::getEntries() const { return values.size(); }
+
+const uint32_t* SparseGrid::getOffsets() const { return offsets.data(); }
+const uint16_t* SparseGrid::getColumns() const { return columns.data(); }
+const float* SparseGrid::getValues() const { return values.data(); }
+const uint8_t* SparseGrid::getMask() const { return mask.data(); }
+
+bool SparseGrid::isNoData(int row, int col) const
+{
+    size_t i = size_t(row) * cols + col;
+    return (nodata[i / 64] >> (i % 64)) & 1;
+}
+
+size_t SparseGrid::countNoData() const
+{
+    size_t n = 0;
+    for (uint64_t w : nodata)
+        n += size_t(__builtin_popcountll(w));
+    return n;
+}
+
+const size_t SparseGrid::getBytes() const
+{
+    return offsets.size() * sizeof(uint32_t) + columns.size() * sizeof(uint16_t) +
+        values.size() * sizeof(float) + mask.size() + nodata.size() * sizeof(uint64_t);
+}
+
+void SparseGrid::push(int col, float v, uint8_t m)
+{
+    columns.push_back(uint16_t(col));
+    values.push_back(v);
+    mask.push_back(m);
+}
+
+void SparseGrid::setNoData(size_t i) { nodata[i / 64] |= uint64_t(1) << (i % 64); }
+
+
+/* CONVERSION --------------------------------------------------------------- */
+
+SparseGrid decodeSparse(const char* src, int rows, int cols, float factor)
+{
+    SparseGrid s(rows, cols);
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(src);
+
+    for (int r = 0; r < rows; r++)
+    {
+        const size_t row = size_t(r) * cols;
+
+        for (int c = 0; c < cols; c++)
+        {
+            // 4 words at once where all are dry (most of a dry day) or all
+            // plain no data (outside the radar coverage); the flags are the
+            // top 3 bits of each high byte
+            if (c + 4 <= cols) {
+                const size_t i = row + c;
+                uint64_t four;
+                std::memcpy(&four, p + 2 * i, 8);
+                if (four == 0) {
+                    c += 3;
+                    continue;
+                }
+                const unsigned char* hi = p + 2 * i + 1;
+                if (((hi[0] & 0xE0) == 0x20) & ((hi[2] & 0xE0) == 0x20) & ((hi[4] & 0xE0) == 0x20) & ((hi[6] & 0xE0) == 0x20)) {
+                    if (i % 64 <= 60)
+                        s.nodata[i / 64] |= uint64_t(0xF) << (i % 64);
+                    else
+                        for (size_t k = i; k < i + 4; k++)
+                            s.setNoData(k);
+                    c += 3;
+                    continue;
+                }
+            }
+
+            const size_t i = row + c;
+            uint16_t w = uint16_t(p[2*i] | (p[2*i+1] << 8));
+            uint8_t m = uint8_t(w >> 13);
+
+            // dry: no flags and value 0 (the interpolated bit is not kept)
+            if (m == 0 && (w & PIXEL_VALUE) == 0)
+                continue;
+
+            if (m == FLAG_NODATA) {
+                s.setNoData(i);
+                continue;
+            }
+
+            // same rules as the decode kernels
+            float v = (w & PIXEL_VALUE) * factor;
+            if (w & PIXEL_NEGATIVE)
+                v = -v;
+            if (w & PIXEL_NODATA)
+                v = nan;
+
+            s.push(c, v, m);
+        }
+
+        s.offsets[r+1] = uint32_t(s.values.size());
+    }
+
+    LOG_DEBUG("decodeSparse: " << rows << "x" << cols << " pixels, " << s.getEntries() << " entries, " << s.countNoData() << " no data");
+
+    return s;
+}
+
+SparseGrid decodeSparse(const MappedFile& f, long etxIndex, const Header& h)
+{
+    if (etxIndex < 0)
+        throw std::invalid_argument("decodeSparse: no ETX byte, hence no payload!");
+
+    size_t offset = size_t(etxIndex) + 1;
+    size_t needed = payloadBytes(h);
+
+    if (f.size() < offset + needed)
+    {
+        std::string msg = "decodeSparse: payload must be of size " + std::to_string(needed) + "!";
+        throw std::invalid_argument(msg);
+    }
+
+    // the word scan above needs RADOLAN words; other encodings (RX) are
+    // decoded by their own decoder first
+    return withProduct(h.getPI(), [&](auto t) {
+        if constexpr (std::is_base_of_v<WordPayload, decltype(t)>)
+            return decodeSparse(f.data() + offset, h.getRows(), h.getCols(), h.getFactor());
+        else
+            return toSparse(decodeGrid(f, etxIndex, h));
+    });
+}
+
+SparseGrid toSparse(const Grid& g)
+{
+    SparseGrid s(g.getRows(), g.getCols());
+
+    const float* values = g.getValues();
+    const uint8_t* mask = g.getMask();
+
+    for (int r = 0; r < g.getRows(); r++)
+    {
+        for (int c = 0; c < g.getCols(); c++)
+        {
+            const size_t i = size_t(r) * g.getCols() + c;
+
+            // NOTE: -0.0 carries FLAG_NEGATIVE, hence is kept as an entry
+            if (mask[i] == 0 && values[i] == 0.0f)
+                continue;
+
+            if (mask[i] == FLAG_NODATA)
+                s.setNoData(i);
+            else
+                s.push(c, values[i], mask[i]);
+        }
+
+        s.offsets[r+1] = uint32_t(s.values.size());
+    }
+
+    return s;
+}
+
+Grid toDense(const SparseGrid& s)
+{
+    // NOTE: grids arrive zeroed, i.e. dry
+    Grid g(s.getRows(), s.getCols());
+
+    float* values = g.getValues();
+    uint8_t* mask = g.getMask();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    // no data: visit set bits only, 64 pixels per word
+    for (size_t b = 0; b < s.nodata.size(); b++)
+    {
+        for (uint64_t bits = s.nodata[b]; bits != 0; bits &= bits - 1) {
+            size_t i = b * 64 + size_t(__builtin_ctzll(bits));
+            values[i] = nan;
+            mask[i] = FLAG_NODATA;
+        }
+    }
+
+    s.forEach([&](int r, int c, float v, uint8_t m) {
+        values[size_t(r) * s.getCols() + c] = v;
+        mask[size_t(r) * s.getCols() + c] = m;
+    });
+
+    return g;
+}
+
+
+/* REDUCTIONS --------------------------------------------------------------- */
+
+Summary summarize(const SparseGrid& s)
+{
+    // dry pixels add nothing, plain no-data pixels only to `nodata`
+    Summary sum;
+    sum.pixels = size_t(s.getRows()) * s.getCols();
+    sum.nodata = s.countNoData();
+
+    const float* values = s.getValues();
+    const uint8_t* mask = s.getMask();
+
+    for (size_t k = 0; k < s.getEntries(); k++)
+    {
+        if (mask[k] & FLAG_NODATA) { sum.nodata++; continue; }
+        if (mask[k] & FLAG_CLUTTER) sum.clutter++;
+        if (values[k] > 0.0f) sum.wet++;
+        if (values[k] > sum.max) sum.max = values[k];
+    }
+    return sum;
+}
+
+void accumulate(const SparseGrid& s, float scale, float* acc)
+{
+    s.forEach([&](int r, int c, float v, uint8_t m) {
+        if (!(m & FLAG_NODATA))
+            acc[size_t(r) * s.getCols() + c] += scale * v;
+    });
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "classes.h"
+#include "payload.h"
+
+
+/* SPARSE GRID -------------------------------------------------------------- */
+
+// A decoded payload that stores only what differs from a dry pixel (value 0,
+// no flags), in compressed sparse row (CSR) form:
+//
+//  - entries of row r are entries offsets[r] to offsets[r+1] - 1, each with
+//    its column, value and FLAG_* mask, columns ascending
+//  - no-data pixels without further flags (the area outside the radar
+//    coverage) are one bit each in a separate bitmap instead of entries
+//
+// Dry pixels cost nothing, hence iterating or accumulating takes time in the
+// number of entries, not rows x cols. Conversion to and from `Grid` is exact.
+
+class SparseGrid {
+private:
+    int rows;
+    int cols;
+
+    std::vector<uint32_t> offsets;      // rows + 1
+    std::vector<uint16_t> columns;
+    std::vector<float> values;
+    std::vector<uint8_t> mask;
+
+    // bit (row * cols + col) set for a pixel that is no data and nothing else
+    std::vector<uint64_t> nodata;
+
+    // append an entry to the current row, or mark pixel i as no data
+    void push(int col, float v, uint8_t m);
+    void setNoData(size_t i);
+
+    friend SparseGrid decodeSparse(const char* src, int rows, int cols, float factor);
+    friend SparseGrid toSparse(const Grid& g);
+    friend Grid toDense(const SparseGrid& s);
+
+public:
+    SparseGrid();
+    SparseGrid(int r, int c);     // all dry; throws std::invalid_argument for more than 65536 columns
+    ~SparseGrid();
+
+    const int getRows() const;
+    const int getCols() const;
+
+    // number of stored pixels, i.e. not dry and not plain no data
+    const size_t getEntries() const;
+
+    const uint32_t* getOffsets() const;
+    const uint16_t* getColumns() const;
+    const float* getValues() const;
+    const uint8_t* getMask() const;
+
+    // true for pixels in the no-data bitmap
+    bool isNoData(int row, int col) const;
+
+    // pixels in the no-data bitmap
+    size_t countNoData() const;
+
+    // bytes held by all arrays
+    const size_t getBytes() const;
+
+    // call f(row, col, value, mask) for every entry, in storage order
+    template <class F>
+    void forEach(F f) const
+    {
+        for (int r = 0; r < rows; r++)
+            for (uint32_t k = offsets[r]; k < offsets[r+1]; k++)
+                f(r, int(columns[k]), values[k], mask[k]);
+    }
+};
+
+
+/* CONVERSION --------------------------------------------------------------- */
+
+// decode rows x cols raw pixel words at src (see payload.h) straight into a
+// sparse grid, without a dense intermediate
+SparseGrid decodeSparse(const char* src, int rows, int cols, float factor);
+
+// decode the payload after the ETX byte at etxIndex of the mapped file f, as
+// `decodeGrid` does; products without pixel words (RX) take the dense decoder
+// and `toSparse`
+SparseGrid decodeSparse(const MappedFile& f, long etxIndex, const Header& h);
+
+SparseGrid toSparse(const Grid& g);
+Grid toDense(const SparseGrid& s);
+
+
+/* REDUCTIONS --------------------------------------------------------------- */
+
+// same counts as `summarize` of the dense grid
+Summary summarize(const SparseGrid& s);
+
+// acc[row * cols + col] += scale * value for every entry with data; acc holds
+// rows x cols elements
+void accumulate(const SparseGrid& s, float scale, float* acc);
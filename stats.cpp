@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "logger.h"
+#include "stats.h"
+
+using namespace std;
+
+
+/* NAMES -------------------------------------------------------------------- */
+
+const char* stageName(Stage s)
+{
+    switch (s)
+    {
+        case Stage::OPEN: return "open";
+        case Stage::ETX: return "etx";
+        case Stage::PARSE: return "parse";
+        case Stage::DECODE: return "decode";
+        case Stage::SUMMARIZE: return "summarize";
+        case Stage::OUTPUT: return "output";
+    }
+    return "unknown";
+}
+
+const char* counterName(Counter c)
+{
+    switch (c)
+    {
+        case Counter::FILES: return "files";
+        case Counter::BYTES_READ: return "bytes_read";
+        case Counter::ALLOCATIONS: return "allocations";
+        case Counter::ERRORS: return "errors";
+    }
+    return "unknown";
+}
+
+
+/* STORAGE ------------------------------------------------------------------ */
+
+// NOTE: zero-initialized before any dynamic initialization, hence counting
+// allocations from operator new during static initialization is safe, too
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[HIST_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;      // ns
+    std::atomic<uint64_t> max;      // ns
+};
+
+static Histogram histograms[STAGE_COUNT];
+static std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+std::atomic<bool> Stats::enabled{false};
+
+static size_t bucketOf(uint64_t ns)
+{
+    // number of significant bits, less the 6 bits below the first bound
+    int bits = 64 - __builtin_clzll(ns | 1);
+    return std::min<size_t>(HIST_BUCKETS - 1, size_t(std::max(0, bits - HIST_SHIFT)));
+}
+
+// upper bound of bucket k in ns
+static double boundOf(size_t k) { return double(uint64_t(1) << (k + HIST_SHIFT)); }
+
+
+void Stats::record(Stage s, uint64_t ns)
+{
+    Histogram& h = histograms[size_t(s)];
+
+    h.buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sum.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t m = h.max.load(std::memory_order_relaxed);
+    while (ns > m && !h.max.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+}
+
+void Stats::count(Counter c, uint64_t n)
+{
+    counters[size_t(c)].fetch_add(n, std::memory_order_relaxed);
+}
+
+
+/* REPORTING ---------------------------------------------------------------- */
+
+static double percentile(const Histogram& h, double q)
+{
+    // upper bound of the bucket that holds the q-th duration, at most max (ns)
+    uint64_t n = h.count.load(std::memory_order_relaxed);
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(q * n + 0.5));
+    uint64_t seen = 0;
+
+    for (size_t k = 0; k < HIST_BUCKETS; k++) {
+        seen += h.buckets[k].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(boundOf(k), double(h.max.load(std::memory_order_relaxed)));
+    }
+    return double(h.max.load(std::memory_order_relaxed));
+}
+
+void Stats::report(std::ostream& os)
+{
+    os << "Stats\n";
+    for (size_t c = 0; c < COUNTER_COUNT; c++)
+        os << " " << std::left << std::setw(12) << counterName(Counter(c)) << std::right << counters[c].load() << "\n";
+
+    os << " " << std::left << std::setw(10) << "stage" << std::right <<
+        std::setw(10) << "count" << std::setw(12) << "total ms" << std::setw(10) << "mean us" <<
+        std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "max us" << "\n";
+
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed;
+
+    for (size_t s = 0; s < STAGE_COUNT; s++)
+    {
+        const Histogram& h = histograms[s];
+        uint64_t n = h.count.load();
+        if (n == 0)
+            continue;
+
+        double sum = double(h.sum.load());
+        os << " " << std::left << std::setw(10) << stageName(Stage(s)) << std::right << std::setw(10) << n <<
+            std::setprecision(3) << std::setw(12) << sum / 1e6 <<
+            std::setprecision(1) << std::setw(10) << sum / n / 1e3 <<
+            std::setw(10) << percentile(h, 0.5) / 1e3 << std::setw(10) << percentile(h, 0.99) / 1e3 <<
+            std::setw(10) << h.max.load() / 1e3 << "\n";
+    }
+
+    os.flags(flags);
+    os << std::flush;
+}
+
+void Stats::writePrometheus(std::ostream& os)
+{
+    os << "# HELP prvh_stage_seconds Wall time per pipeline stage.\n"
+          "# TYPE prvh_stage_seconds histogram\n";
+
+    for (size_t s = 0; s < STAGE_COUNT; s++)
+    {
+        const Histogram& h = histograms[s];
+        const char* name = stageName(Stage(s));
+
+        // buckets are cumulative in this format
+        uint64_t seen = 0;
+        for (size_t k = 0; k + 1 < HIST_BUCKETS; k++) {
+            seen += h.buckets[k].load();
+            os << "prvh_stage_seconds_bucket{stage=\"" << name << "\",le=\"" << boundOf(k) / 1e9 << "\"} " << seen << "\n";
+        }
+        os << "prvh_stage_seconds_bucket{stage=\"" << name << "\",le=\"+Inf\"} " << h.count.load() << "\n";
+        os << "prvh_stage_seconds_sum{stage=\"" << name << "\"} " << h.sum.load() / 1e9 << "\n";
+        os << "prvh_stage_seconds_count{stage=\"" << name << "\"} " << h.count.load() << "\n";
+    }
+
+    for (size_t c = 0; c < COUNTER_COUNT; c++)
+    {
+        const char* name = counterName(Counter(c));
+        os << "# TYPE prvh_" << name << "_total counter\n";
+        os << "prvh_" << name << "_total " << counters[c].load() << "\n";
+    }
+}
+
+
+StatsReport::~StatsReport()
+{
+    if (!Stats::isEnabled())
+        return;
+
+    // stop counting, e.g. the allocations of the report itself
+    Stats::enable(false);
+
+    if (os)
+        Stats::report(*os);
+
+    if (!path.empty()) {
+        // write to a temporary file and rename it, so scrapers never see half a file
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            Stats::writePrometheus(out);
+            if (!out) {
+                LOG_ERROR("StatsReport: unable to write " << tmp);
+                return;
+            }
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0)
+            LOG_ERROR("StatsReport: unable to rename " << tmp << " to " << path);
+    }
+}
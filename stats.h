@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+
+/* STAGES AND COUNTERS ------------------------------------------------------ */
+
+// pipeline stages with a latency histogram each
+//  OPEN       open and map a file
+//  ETX        find the ETX byte
+//  PARSE      parse the ASCII header (all fields and setters)
+//  DECODE     decode the payload
+//  SUMMARIZE  summarize a decoded grid
+//  OUTPUT     print or serialize one result
+
+enum class Stage { OPEN, ETX, PARSE, DECODE, SUMMARIZE, OUTPUT };
+
+const size_t STAGE_COUNT = 6;
+
+enum class Counter { FILES, BYTES_READ, ALLOCATIONS, ERRORS };
+
+const size_t COUNTER_COUNT = 4;
+
+// e.g. "parse", "bytes_read"
+const char* stageName(Stage s);
+const char* counterName(Counter c);
+
+// histogram bucket k counts durations below 2^(k + HIST_SHIFT) ns, i.e. from
+// 64 ns up to 137 s in powers of 2; the last bucket takes everything above
+const size_t HIST_BUCKETS = 32;
+const int HIST_SHIFT = 6;
+
+
+/* STATS -------------------------------------------------------------------- */
+
+// Process-wide, thread-safe statistics (relaxed atomics only). Everything is
+// off until `enable` is called: a disabled timer or counter costs one relaxed
+// load and a branch, and reads no clock.
+
+class Stats {
+private:
+    static std::atomic<bool> enabled;
+
+    Stats() = default;
+
+public:
+    static void enable(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // one duration of stage s
+    static void record(Stage s, uint64_t ns);
+
+    // add n to counter c, if enabled
+    static void add(Counter c, uint64_t n = 1) { if (isEnabled()) count(c, n); }
+    static void count(Counter c, uint64_t n);
+
+    // human-readable table: count, total, mean, p50, p99 and max per stage
+    static void report(std::ostream& os);
+
+    // Prometheus text exposition format: one histogram `prvh_stage_seconds`
+    // labelled by stage, one counter `prvh_<name>_total` per counter
+    static void writePrometheus(std::ostream& os);
+
+    Stats(const Stats&) = delete;
+    void operator=(const Stats&) = delete;
+};
+
+
+/* SCOPED TIMER ------------------------------------------------------------- */
+
+// records the time from construction to `stop` or destruction, whichever
+// comes first, as one duration of stage s (steady clock)
+
+class StageTimer {
+private:
+    Stage stage;
+    bool running;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StageTimer(Stage s) : stage(s), running(Stats::isEnabled())
+    {
+        if (running)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer() { stop(); }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        Stats::record(stage, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    void operator=(const StageTimer&) = delete;
+};
+
+
+/* REPORT ------------------------------------------------------------------- */
+
+// prints the report to os and/or exports it to a file when it goes out of
+// scope, i.e. on every return path of `main`; does nothing if stats are off
+
+class StatsReport {
+private:
+    std::ostream* os;
+    std::string path;
+
+public:
+    StatsReport(std::ostream* os, const std::string& path) : os(os), path(path) {}
+    ~StatsReport();
+
+    StatsReport(const StatsReport&) = delete;
+    void operator=(const StatsReport&) = delete;
+};
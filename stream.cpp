@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bzlib.h>
+
+#include "batch.h"
+#include "classes.h"
+#include "logger.h"
+#include "payload.h"
+#include "stats.h"
+#include "stream.h"
+#include "traits.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* SOURCES ------------------------------------------------------------------ */
+
+Source::~Source() {}
+
+
+FdSource::FdSource(int fd) : fd(fd) {}
+
+FdSource::~FdSource()
+{
+    if (fd != STDIN_FILENO)
+        ::close(fd);
+}
+
+size_t FdSource::read(char* b, size_t n)
+{
+    for (;;)
+    {
+        ssize_t k = ::read(fd, b, n);
+        if (k >= 0)
+            return size_t(k);
+        if (errno != EINTR)
+            throw std::runtime_error("FdSource: read failed");
+    }
+}
+
+
+Bz2Source::Bz2Source(Source& in) : in(in), buffer(1 << 16), inEnd(false), streamEnd(false)
+{
+    std::memset(&bz, 0, sizeof(bz));
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK)
+        throw std::runtime_error("Bz2Source: unable to initialize bzip2");
+}
+
+Bz2Source::~Bz2Source() { BZ2_bzDecompressEnd(&bz); }
+
+size_t Bz2Source::read(char* b, size_t n)
+{
+    bz.next_out = b;
+    bz.avail_out = static_cast<unsigned>(std::min<size_t>(n, 1u << 30));
+
+    while (bz.avail_out > 0)
+    {
+        if (bz.avail_in == 0 && !inEnd)
+        {
+            size_t k = in.read(buffer.data(), buffer.size());
+            bz.next_in = buffer.data();
+            bz.avail_in = static_cast<unsigned>(k);
+            inEnd = (k == 0);
+        }
+
+        // end of one bzip2 stream: start over if more input follows
+        if (streamEnd)
+        {
+            if (bz.avail_in == 0 && inEnd)
+                break;
+            char* nextIn = bz.next_in;
+            unsigned availIn = bz.avail_in;
+            char* nextOut = bz.next_out;
+            unsigned availOut = bz.avail_out;
+
+            BZ2_bzDecompressEnd(&bz);
+            std::memset(&bz, 0, sizeof(bz));
+            if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK)
+                throw std::runtime_error("Bz2Source: unable to initialize bzip2");
+
+            bz.next_in = nextIn;
+            bz.avail_in = availIn;
+            bz.next_out = nextOut;
+            bz.avail_out = availOut;
+            streamEnd = false;
+        }
+
+        unsigned before = bz.avail_out;
+        int rc = BZ2_bzDecompress(&bz);
+
+        if (rc == BZ_STREAM_END)
+            streamEnd = true;
+        else if (rc != BZ_OK)
+            throw std::runtime_error("Bz2Source: corrupt bzip2 data");
+        else if (inEnd && bz.avail_in == 0 && bz.avail_out == before)
+            throw std::runtime_error("Bz2Source: truncated bzip2 data");
+
+        // hand out what we have rather than blocking for more input
+        if (bz.avail_out < before && bz.avail_in == 0)
+            break;
+    }
+
+    return n - bz.avail_out;
+}
+
+
+Reader::Reader(Source& src, size_t capacity) : src(src), buffer(capacity), pos(0), end(0), eof(false) {}
+
+size_t Reader::peek(size_t n)
+{
+    if (end - pos >= n || eof)
+        return std::min(n, end - pos);
+
+    // move the unread rest to the front and make room for n bytes
+    std::memmove(buffer.data(), buffer.data() + pos, end - pos);
+    end -= pos;
+    pos = 0;
+    if (buffer.size() < n)
+        buffer.resize(n);
+
+    while (end < n && !eof)
+    {
+        size_t k = src.read(buffer.data() + end, buffer.size() - end);
+        end += k;
+        eof = (k == 0);
+    }
+
+    return std::min(n, end);
+}
+
+const char* Reader::data() const { return buffer.data() + pos; }
+
+void Reader::consume(size_t n) { pos += std::min(n, end - pos); }
+
+size_t Reader::skip(size_t n)
+{
+    size_t done = 0;
+
+    while (done < n)
+    {
+        size_t k = peek(std::min(n - done, buffer.size()));
+        if (k == 0)
+            break;
+        consume(k);
+        done += k;
+    }
+    return done;
+}
+
+size_t Reader::read(char* b, size_t n)
+{
+    // serve buffered bytes first, then read large requests straight through
+    if (pos == end && !eof && n >= buffer.size())
+        return src.read(b, n);
+
+    size_t k = peek(std::min(n, buffer.size()));
+    std::memcpy(b, data(), k);
+    consume(k);
+    return k;
+}
+
+
+/* MEMBERS ------------------------------------------------------------------ */
+
+// A member without an ETX byte in its first HEADER_MAX bytes (see utils.h) is
+// rejected, which keeps the header in the read buffer, hence parseHeader works
+// on it in place.
+
+static Result processMember(Reader& r, const std::string& name, size_t size, bool decode, Grid& grid)
+{
+    // parse one member of `size` bytes (SIZE_MAX: up to the end of the stream)
+    // and leave the reader right behind it
+    Result res;
+    res.header.setFN(name);
+    size_t used = 0;
+    Stats::add(Counter::FILES);
+
+    try {
+        size_t n = r.peek(std::min(size, HEADER_MAX));
+
+        StageTimer etx(Stage::ETX);
+        long etxIndex = findETX(r.data(), n);
+        etx.stop();
+        if (etxIndex < 0)
+            throw std::invalid_argument("no ETX byte in " + name);
+
+        StageTimer parse(Stage::PARSE);
+        parseHeader(std::string_view(r.data(), etxIndex), res.header);
+        parse.stop();
+        res.etxIndex = etxIndex;
+        r.consume(etxIndex + 1);
+        used = etxIndex + 1;
+
+        if (decode)
+        {
+            const Header& h = res.header;
+            if (grid.getRows() != h.getRows() || grid.getCols() != h.getCols())
+                grid = Grid(h.getRows(), h.getCols());
+
+            // decode the payload chunk by chunk as it passes through the buffer;
+            // NOTE: the DECODE stage includes reading (and decompressing) it
+            StageTimer decoding(Stage::DECODE);
+            size_t total = grid.getSize();
+            size_t bpp = bytesPerPixel(h.getPI());
+            if (size != SIZE_MAX && size - used < total * bpp)
+                throw std::invalid_argument("decodeGrid: payload must be of size " + std::to_string(total * bpp) + "!");
+
+            for (size_t done = 0; done < total; )
+            {
+                size_t pixels = r.peek(std::min<size_t>(total - done, 1 << 14) * bpp) / bpp;
+                if (pixels == 0)
+                    throw std::invalid_argument("decodeGrid: payload must be of size " + std::to_string(total * bpp) + "!");
+
+                decodeProduct(h.getPI(), r.data(), pixels, h.getFactor(), grid.getValues() + done, grid.getMask() + done);
+                r.consume(pixels * bpp);
+                used += pixels * bpp;
+                done += pixels;
+            }
+
+            decoding.stop();
+
+            StageTimer summary(Stage::SUMMARIZE);
+            res.summary = summarize(grid);
+            res.decoded = true;
+        }
+    }
+    // NOTE: read errors (runtime_error) break the whole stream, see processStream
+    catch (const std::logic_error& e) {
+        LOG_ERROR("processStream: " << e.what());
+        res.error = "Could not parse file " + name + ": " + e.what();
+        Stats::add(Counter::ERRORS);
+    }
+
+    // rest of the member, e.g. the payload when only headers are parsed
+    if (size == SIZE_MAX)
+        used += r.skip(SIZE_MAX);
+    else if (r.skip(size - used) != size - used)
+        throw std::runtime_error("processStream: " + name + " is truncated");
+    else
+        used = size;
+
+    // a stream passes every byte through the read buffer
+    Stats::add(Counter::BYTES_READ, used);
+
+    return res;
+}
+
+
+/* TAR ---------------------------------------------------------------------- */
+
+// ustar header fields; see POSIX.1-2001 `pax` and GNU tar
+
+static size_t tarNumber(const char* f, size_t width)
+{
+    // octal, padded with spaces or '\0'; GNU base-256 if the high bit is set
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(f);
+
+    if (u[0] & 0x80) {
+        size_t v = u[0] & 0x3F;
+        for (size_t k = 1; k < width; k++)
+            v = (v << 8) | u[k];
+        return v;
+    }
+
+    size_t v = 0;
+    for (size_t k = 0; k < width && f[k] >= '0' && f[k] <= '7'; k++)
+        v = v * 8 + size_t(f[k] - '0');
+    return v;
+}
+
+static std::string tarString(const char* f, size_t width) { return std::string(f, strnlen(f, width)); }
+
+static bool isTar(const char* block) { return std::memcmp(block + 257, "ustar", 5) == 0; }
+
+static std::string readString(Reader& r, size_t n)
+{
+    std::string s(n, '\0');
+    size_t k = 0;
+    while (k < n) {
+        size_t m = r.read(s.data() + k, n - k);
+        if (m == 0)
+            throw std::runtime_error("processStream: truncated tar archive");
+        k += m;
+    }
+    return s;
+}
+
+static void processTar(Reader& r, const std::string& path, bool decode, std::vector<Result>& results)
+{
+    Grid grid;
+    std::string longName;
+
+    for (;;)
+    {
+        size_t n = r.peek(512);
+        if (n == 0)
+            break;
+        if (n < 512)
+            throw std::runtime_error("processStream: truncated tar archive " + path);
+
+        // a zero block marks the end of the archive
+        const char* b = r.data();
+        if (std::all_of(b, b + 512, [](char c) { return c == 0; }))
+            break;
+
+        std::string name = tarString(b + 345, 155);
+        name = (name.empty() ? "" : name + "/") + tarString(b, 100);
+        size_t size = tarNumber(b + 124, 12);
+        char type = b[156];
+        size_t padding = (512 - size % 512) % 512;
+        r.consume(512);
+
+        if (!longName.empty()) {
+            name = longName;
+            longName.clear();
+        }
+
+        switch (type)
+        {
+            // GNU long name of the next member
+            case 'L':
+                longName = readString(r, size).c_str();
+                break;
+
+            // pax extended header: "<len> path=<name>\n" overrides the name
+            case 'x': {
+                std::string pax = readString(r, size);
+                size_t k = pax.find(" path=");
+                if (k != std::string::npos)
+                    longName = pax.substr(k + 6, pax.find('\n', k) - k - 6);
+                break;
+            }
+
+            // regular file
+            case '0': case '\0': case '7':
+                results.push_back(processMember(r, path + ":" + name, size, decode, grid));
+                break;
+
+            // directories, links, ...
+            default:
+                r.skip(size);
+        }
+
+        r.skip(padding);
+    }
+}
+
+
+/* STREAMS ------------------------------------------------------------------ */
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isStream(const std::string& arg)
+{
+    return arg == "-" || endsWith(arg, ".tar") || endsWith(arg, ".tar.bz2") || endsWith(arg, ".tbz2") || endsWith(arg, ".tbz");
+}
+
+std::vector<Result> processStream(const std::string& path, bool decode)
+{
+    std::vector<Result> results;
+
+    int fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Result r;
+        r.header.setFN(path);
+        r.error = "Could not open file " + path;
+        results.push_back(r);
+        return results;
+    }
+
+    FdSource file(fd);
+    Reader raw(file);
+    std::string name = path == "-" ? "<stdin>" : path;
+
+    try {
+        // bzip2 streams start with "BZh" and the block size digit
+        std::unique_ptr<Bz2Source> bz;
+        std::unique_ptr<Reader> unpacked;
+        Reader* r = &raw;
+
+        if (raw.peek(3) == 3 && std::memcmp(raw.data(), "BZh", 3) == 0) {
+            bz = std::make_unique<Bz2Source>(raw);
+            unpacked = std::make_unique<Reader>(*bz);
+            r = unpacked.get();
+        }
+
+        if (r->peek(512) == 512 && isTar(r->data())) {
+            processTar(*r, name, decode, results);
+        }
+        else {
+            Grid grid;
+            results.push_back(processMember(*r, name, SIZE_MAX, decode, grid));
+        }
+    }
+    catch (const std::exception& e) {
+        // stream is broken: keep what was parsed, report the rest as one error
+        LOG_ERROR("processStream: " << e.what());
+        Result r;
+        r.header.setFN(name);
+        r.error = "Could not read " + name + ": " + e.what();
+        results.push_back(r);
+    }
+
+    LOG_INFO("processStream: " << results.size() << " files from " << name);
+
+    return results;
+}
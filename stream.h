@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <bzlib.h>
+
+#include "batch.h"
+
+
+/* SOURCES ------------------------------------------------------------------ */
+
+// a forward-only byte stream; read returns 0 at the end of the stream
+
+class Source {
+public:
+    virtual ~Source();
+    virtual size_t read(char* b, size_t n) = 0;
+};
+
+
+// file descriptor, e.g. stdin or a pipe; closed on destruction unless stdin
+
+class FdSource : public Source {
+private:
+    int fd;
+
+public:
+    explicit FdSource(int fd);
+    ~FdSource();
+
+    size_t read(char* b, size_t n) override;
+};
+
+
+// bzip2-decompressed view of another source; concatenated bzip2 streams (as
+// written by pbzip2) are decompressed one after another
+
+class Bz2Source : public Source {
+private:
+    Source& in;
+    bz_stream bz;
+    std::vector<char> buffer;
+    bool inEnd;
+    bool streamEnd;
+
+public:
+    explicit Bz2Source(Source& in);
+    ~Bz2Source();
+
+    size_t read(char* b, size_t n) override;
+};
+
+
+// buffered reader over a source: `peek` makes bytes visible in place, so the
+// parser can work on them without copying, `consume` moves past them
+
+class Reader : public Source {
+private:
+    Source& src;
+    std::vector<char> buffer;
+    size_t pos;
+    size_t end;
+    bool eof;
+
+public:
+    explicit Reader(Source& src, size_t capacity = 1 << 16);
+
+    // buffer at least n bytes; returns the number available (less only at the
+    // end of the stream); `data` points at them until the next peek or read
+    size_t peek(size_t n);
+    const char* data() const;
+
+    // drop n buffered bytes (n <= available)
+    void consume(size_t n);
+
+    // drop n bytes, reading them from the source if needed; returns the number
+    // of bytes skipped (less only at the end of the stream)
+    size_t skip(size_t n);
+
+    size_t read(char* b, size_t n) override;
+};
+
+
+/* STREAMS ------------------------------------------------------------------ */
+
+// true for arguments that are read as a stream: "-" (stdin) and tar archives
+// (.tar, .tar.bz2, .tbz2, .tbz)
+bool isStream(const std::string& arg);
+
+// Parse every RV file of the stream at path ("-": stdin) in a single pass.
+// The stream may be a tar archive or a single RV file, either of them bzip2-
+// compressed; this is detected from the first bytes. Each member is parsed
+// (and decoded, see `processFile`) while it passes through the read buffer,
+// without temporary files or seeking.
+//
+// Results are in stream order and named `path:member`; `etxIndex` is relative
+// to the member, hence cubes and queries, which read the files again, do not
+// work on streamed results.
+std::vector<Result> processStream(const std::string& path, bool decode);
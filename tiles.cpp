@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRVH_X86 1
+#endif
+
+#include "logger.h"
+#include "payload.h"
+#include "tiles.h"
+#include "utils.h"
+
+using namespace std;
+
+
+/* PYRAMID ------------------------------------------------------------------ */
+
+Aggregation parseAggregation(const std::string& s)
+{
+    if (s == "mean")
+        return Aggregation::MEAN;
+    if (s == "max")
+        return Aggregation::MAX;
+    throw std::invalid_argument("parseAggregation: unknown aggregation " + s + "!");
+}
+
+
+static void prepare(Grid& g, int rows, int cols)
+{
+    // reuse the grid if it already has the right size
+    if (g.getRows() != rows || g.getCols() != cols)
+        g = Grid(rows, cols);
+}
+
+static inline float aggregate(float a, float b, float c, float d, Aggregation agg)
+{
+    // NaN (no data, or a child outside the level) fails every comparison;
+    // branch-free, as no data is common in the radar composite
+    const float ninf = -std::numeric_limits<float>::infinity();
+    float v[4] = {a, b, c, d};
+    float sum = 0.0f;
+    float mx = ninf;
+    float n = 0.0f;
+
+    for (int k = 0; k < 4; k++) {
+        bool ok = v[k] == v[k];
+        sum += ok ? v[k] : 0.0f;
+        n += ok ? 1.0f : 0.0f;
+        mx = (ok && v[k] > mx) ? v[k] : mx;
+    }
+
+    float r = agg == Aggregation::MEAN ? sum / n : mx;
+    return n > 0.0f ? r : std::numeric_limits<float>::quiet_NaN();
+}
+
+static void halveScalar(const float* a, const float* b, int cols, float* v, uint8_t* m, int n, Aggregation agg)
+{
+    // one output row from input rows a and b (a again for an odd last row)
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const int full = cols / 2;
+
+    if (agg == Aggregation::MEAN)
+        for (int x = 0; x < full; x++)
+            v[x] = aggregate(a[2*x], a[2*x+1], b[2*x], b[2*x+1], Aggregation::MEAN);
+    else
+        for (int x = 0; x < full; x++)
+            v[x] = aggregate(a[2*x], a[2*x+1], b[2*x], b[2*x+1], Aggregation::MAX);
+
+    // odd number of columns: the last pixel has no right children
+    if (full < n)
+        v[full] = aggregate(a[2*full], nan, b[2*full], nan, agg);
+
+    for (int x = 0; x < n; x++)
+        m[x] = (v[x] == v[x]) ? 0 : FLAG_NODATA;
+}
+
+#ifdef PRVH_X86
+
+__attribute__((target("avx2")))
+static void halveAVX2(const float* a, const float* b, int cols, float* v, uint8_t* m, int n, Aggregation agg)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    const __m256 ninf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    const __m256 nan  = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const __m128i nodata = _mm_set1_epi8(FLAG_NODATA);
+    const bool mean = agg == Aggregation::MEAN;
+
+    // 8 output pixels from 16 pixels of each input row
+    int x = 0;
+    for (; x + 8 <= cols / 2; x += 8)
+    {
+        __m256 c[4];
+        for (int r = 0; r < 2; r++)
+        {
+            const float* row = r ? b : a;
+            __m256 lo = _mm256_loadu_ps(row + 2*x);
+            __m256 hi = _mm256_loadu_ps(row + 2*x + 8);
+
+            // deinterleave into even and odd columns; the shuffle works per
+            // 128-bit lane, the permute restores the order of the lanes
+            c[2*r]   = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+            c[2*r+1] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+
+        __m256 sum = zero;
+        __m256 count = zero;
+        __m256 mx = ninf;
+        for (int k = 0; k < 4; k++) {
+            // ordered compare: all ones unless c[k] is NaN
+            __m256 valid = _mm256_cmp_ps(c[k], c[k], _CMP_ORD_Q);
+            sum = _mm256_add_ps(sum, _mm256_and_ps(c[k], valid));
+            count = _mm256_add_ps(count, _mm256_and_ps(one, valid));
+            // max returns the second operand if the first is NaN
+            mx = _mm256_max_ps(c[k], mx);
+        }
+
+        __m256 none = _mm256_cmp_ps(count, zero, _CMP_EQ_OQ);
+        __m256 r = mean ? _mm256_div_ps(sum, count) : mx;
+        _mm256_storeu_ps(v + x, _mm256_blendv_ps(r, nan, none));
+
+        // 8 lanes of 0 / -1 → 8 bytes of 0 / FLAG_NODATA
+        __m256i n32 = _mm256_castps_si256(none);
+        __m128i n16 = _mm_packs_epi32(_mm256_castsi256_si128(n32), _mm256_extracti128_si256(n32, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(m + x), _mm_and_si128(_mm_packs_epi16(n16, n16), nodata));
+    }
+
+    // rest of the row; clear the upper halves first, as in decodeAVX2
+    _mm256_zeroupper();
+    halveScalar(a + 2*x, b + 2*x, cols - 2*x, v + x, m + x, n - x, agg);
+}
+
+#endif
+
+
+/* DISPATCH ----------------------------------------------------------------- */
+
+// typedef for a kernel function pointer: one output row of n pixels from the
+// input rows a and b of `cols` pixels each
+using HalveFunction = void (*)(const float*, const float*, int, float*, uint8_t*, int, Aggregation);
+
+struct HalveKernel {
+    const char* name;
+    HalveFunction func;
+};
+
+static HalveKernel selectKernel()
+{
+#ifdef PRVH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", halveAVX2};
+#endif
+    return {"scalar", halveScalar};
+}
+
+static const HalveKernel& kernel()
+{
+    // NOTE: function-local static → selected once, thread-safe since C++11
+    static const HalveKernel k = selectKernel();
+    return k;
+}
+
+const char* pyramidKernel() { return kernel().name; }
+
+
+/* LEVELS ------------------------------------------------------------------- */
+
+static void halve(const Grid& in, Grid& out, Aggregation agg)
+{
+    const int rows = in.getRows();
+    const int cols = in.getCols();
+
+    prepare(out, (rows + 1) / 2, (cols + 1) / 2);
+
+    for (int y = 0; y < out.getRows(); y++)
+    {
+        // for an odd number of rows the last row is its own lower neighbour,
+        // which changes neither the mean nor the max
+        const float* a = in.getValues() + size_t(2 * y) * cols;
+        const float* b = (2 * y + 1 < rows) ? a + cols : a;
+
+        kernel().func(a, b, cols, out.getValues() + size_t(y) * out.getCols(), out.getMask() + size_t(y) * out.getCols(), out.getCols(), agg);
+    }
+}
+
+void buildPyramid(const float* values, int rows, int cols, Aggregation agg, std::vector<Grid>& levels)
+{
+    if (rows <= 0 || cols <= 0)
+        throw std::invalid_argument("buildPyramid: grid must not be empty!");
+
+    // number of levels: halve until the level fits into one tile
+    size_t n = 1;
+    for (int r = rows, c = cols; r > TILE_SIZE || c > TILE_SIZE; r = (r + 1) / 2, c = (c + 1) / 2)
+        n++;
+    levels.resize(n);
+
+    prepare(levels[0], rows, cols);
+    const size_t size = levels[0].getSize();
+    std::memcpy(levels[0].getValues(), values, size * sizeof(float));
+
+    uint8_t* mask = levels[0].getMask();
+    for (size_t i = 0; i < size; i++)
+        mask[i] = (values[i] == values[i]) ? 0 : FLAG_NODATA;
+
+    for (size_t k = 1; k < n; k++)
+        halve(levels[k - 1], levels[k], agg);
+}
+
+void buildPyramid(const Grid& g, Aggregation agg, std::vector<Grid>& levels)
+{
+    buildPyramid(g.getValues(), g.getRows(), g.getCols(), agg, levels);
+}
+
+
+/* TILES -------------------------------------------------------------------- */
+
+uint64_t hashTile(const Grid& g, int row, int col)
+{
+    const int y0 = row * TILE_SIZE;
+    const int x0 = col * TILE_SIZE;
+    const int h = std::min(TILE_SIZE, g.getRows() - y0);
+    const int w = std::min(TILE_SIZE, g.getCols() - x0);
+
+    // the extent is part of the hash: edge tiles are padded with NaN
+    uint64_t acc = (uint64_t(h) << 32) | uint32_t(w);
+
+    for (int y = 0; y < h; y++) {
+        const float* line = g.getValues() + size_t(y0 + y) * g.getCols() + x0;
+        acc = hashBytes(reinterpret_cast<const char*>(line), size_t(w) * sizeof(float), acc);
+    }
+
+    return acc;
+}
+
+
+TileCache::TileCache(const std::string& dir) : dir(dir), buffer(size_t(TILE_SIZE) * TILE_SIZE * sizeof(float)), written(0), reused(0)
+{
+    std::filesystem::create_directories(dir);
+
+    // tiles of earlier runs
+    for (const auto& entry : std::filesystem::directory_iterator(dir))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.size() == 20 && name.compare(16, 4, ".f32") == 0 && name.find_first_not_of("0123456789abcdef") == 16)
+            stored.insert(std::stoull(name.substr(0, 16), nullptr, 16));
+    }
+
+    LOG_INFO("TileCache: " << stored.size() << " tiles in " << dir);
+}
+
+// destructor: for now empty, as the set and buffer clean up after themselves
+TileCache::~TileCache() {}
+
+std::string TileCache::pathOf(uint64_t h) const
+{
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.f32", static_cast<unsigned long long>(h));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+std::vector<TileRef> TileCache::update(const std::vector<Grid>& levels)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    std::vector<TileRef> refs;
+
+    for (size_t k = 0; k < levels.size(); k++)
+    {
+        const Grid& g = levels[k];
+        const int tileRows = (g.getRows() + TILE_SIZE - 1) / TILE_SIZE;
+        const int tileCols = (g.getCols() + TILE_SIZE - 1) / TILE_SIZE;
+
+        for (int row = 0; row < tileRows; row++)
+        {
+            for (int col = 0; col < tileCols; col++)
+            {
+                uint64_t h = hashTile(g, row, col);
+                refs.push_back({int(k), row, col, h});
+
+                if (stored.count(h)) {
+                    reused++;
+                    continue;
+                }
+
+                // encode: rows of the level, padded with NaN
+                // NOTE: float32 is written in host byte order, i.e. little-endian on x86 and ARM
+                float* tile = reinterpret_cast<float*>(buffer.data());
+                std::fill(tile, tile + size_t(TILE_SIZE) * TILE_SIZE, nan);
+
+                const int y0 = row * TILE_SIZE;
+                const int x0 = col * TILE_SIZE;
+                const int th = std::min(TILE_SIZE, g.getRows() - y0);
+                const int tw = std::min(TILE_SIZE, g.getCols() - x0);
+                for (int y = 0; y < th; y++)
+                    std::memcpy(tile + size_t(y) * TILE_SIZE, g.getValues() + size_t(y0 + y) * g.getCols() + x0, size_t(tw) * sizeof(float));
+
+                // write to a temporary file and rename it, so readers never see half a tile
+                std::string path = pathOf(h);
+                std::string tmp = path + ".tmp";
+                {
+                    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                    if (!out.write(buffer.data(), buffer.size()))
+                        throw std::runtime_error("TileCache: unable to write " + tmp);
+                }
+                if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+                    std::remove(tmp.c_str());
+                    throw std::runtime_error("TileCache: unable to rename " + tmp + " to " + path);
+                }
+
+                stored.insert(h);
+                written++;
+            }
+        }
+    }
+
+    return refs;
+}
+
+const size_t TileCache::getWritten() const { return written; }
+const size_t TileCache::getReused() const { return reused; }
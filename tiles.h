@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "payload.h"
+
+
+/* PYRAMID ------------------------------------------------------------------ */
+
+// how four pixels of a level become one pixel of the next, coarser level;
+// both ignore no-data pixels, and a pixel without any valid child is no data
+// (NaN, FLAG_NODATA); the masks of all levels carry FLAG_NODATA only
+
+enum class Aggregation { MEAN, MAX };
+
+// "mean" or "max"; throws std::invalid_argument for anything else
+Aggregation parseAggregation(const std::string& s);
+
+// edge length of a square tile in pixels
+const int TILE_SIZE = 256;
+
+// Build the pyramid of a rows x cols grid into `levels`: level 0 is a copy of
+// the grid, level k + 1 halves level k (rounding up), up to the first level
+// that fits into one tile. Grids of the right size are reused, hence building
+// the pyramids of successive steps does not allocate.
+void buildPyramid(const float* values, int rows, int cols, Aggregation agg, std::vector<Grid>& levels);
+void buildPyramid(const Grid& g, Aggregation agg, std::vector<Grid>& levels);
+
+// name of the kernel selected at runtime ("avx2" or "scalar")
+const char* pyramidKernel();
+
+
+/* TILES -------------------------------------------------------------------- */
+
+// A tile is the TILE_SIZE x TILE_SIZE window at (row, col) * TILE_SIZE of one
+// level, stored as little-endian float32 in row-major order, NaN for no data
+// and outside the level. Tiles are addressed by a 64-bit hash of their values,
+// hence identical tiles (e.g. of a step where nothing changed, or the dry
+// tiles of any step) are stored and encoded once.
+
+struct TileRef {
+    int level;
+    int row;
+    int col;
+    uint64_t hash;
+};
+
+// hash of the values of the tile at (row, col) of g
+uint64_t hashTile(const Grid& g, int row, int col);
+
+// Content-addressed tile store in a directory: `<dir>/<hash>.f32`, with the
+// hash as 16 hex digits. Tiles already in the directory, from this process or
+// an earlier one, are never written again.
+
+class TileCache {
+private:
+    std::string dir;
+
+    // hashes of the tiles in dir
+    std::unordered_set<uint64_t> stored;
+
+    // encode buffer of one tile
+    std::vector<char> buffer;
+
+    size_t written;
+    size_t reused;
+
+public:
+    TileCache(const std::string& dir);
+    ~TileCache();
+
+    // path of the tile with hash h
+    std::string pathOf(uint64_t h) const;
+
+    // tiles of all levels of the pyramid; writes the tiles not yet stored and
+    // returns the reference of every tile, level by level in row-major order
+    std::vector<TileRef> update(const std::vector<Grid>& levels);
+
+    // tiles written and tiles found in the store since construction
+    const size_t getWritten() const;
+    const size_t getReused() const;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "classes.h"
+#include "payload.h"
+#include "utils.h"
+
+
+/* PRODUCTS ----------------------------------------------------------------- */
+
+// The DWD composites share the positional part of the ASCII header (PI, time
+// stamp, WMO), but differ in their keyed fields, grid and payload encoding.
+// Each product is one specialization of `ProductTraits` with
+//
+//  PI               product ID ("Produktkennung")
+//  FIELDS           its keyed fields as indices into METAINFO, in file order
+//  BYTES_PER_PIXEL  payload bytes per pixel
+//  AMOUNT           whether values are precipitation amounts (mm per interval)
+//  decode           payload decoder, as `decodePayload`
+//
+// `withProduct` picks the specialization once per file, hence the field table
+// and the pixel loop of each product are inlined, without virtual calls.
+
+enum class Product { RV, RW, RY, YW, RX };
+
+template <Product P> struct ProductTraits;
+
+// index of a keyed field in METAINFO, at compile time
+constexpr int field(const char (&key)[3]) { return findMetaInfo(key[0], key[1]); }
+
+// RADOLAN words: 2 bytes per pixel (see payload.h), precipitation amounts
+struct WordPayload {
+    static constexpr size_t BYTES_PER_PIXEL = 2;
+    static constexpr bool AMOUNT = true;
+
+    static void decode(const char* src, size_t n, float factor, float* values, uint8_t* mask)
+    {
+        decodePayload(src, n, factor, values, mask);
+    }
+};
+
+// RV: precipitation forecast, 5 min, DE1200 grid
+template <> struct ProductTraits<Product::RV> : WordPayload {
+    static constexpr std::string_view PI = "RV";
+    static constexpr int FIELDS[] = {field("BY"), field("VS"), field("SW"), field("PR"), field("IN"), field("GP"), field("VV"), field("MF"), field("MS")};
+};
+
+// RW: hourly precipitation, 0.1 mm
+template <> struct ProductTraits<Product::RW> : WordPayload {
+    static constexpr std::string_view PI = "RW";
+    static constexpr int FIELDS[] = {field("BY"), field("VS"), field("SW"), field("PR"), field("IN"), field("GP"), field("MF"), field("MS")};
+};
+
+// RY: 5 min precipitation, 0.01 mm
+template <> struct ProductTraits<Product::RY> : WordPayload {
+    static constexpr std::string_view PI = "RY";
+    static constexpr int FIELDS[] = {field("BY"), field("VS"), field("SW"), field("PR"), field("IN"), field("GP"), field("MF"), field("MS")};
+};
+
+// YW: 5 min precipitation on the extended (1100x900) grid
+template <> struct ProductTraits<Product::YW> : WordPayload {
+    static constexpr std::string_view PI = "YW";
+    static constexpr int FIELDS[] = {field("BY"), field("VS"), field("SW"), field("PR"), field("IN"), field("GP"), field("VV"), field("MF"), field("MS")};
+};
+
+// RX: reflectivity, 1 byte per pixel in RVP6 units (see decodeRVP6)
+template <> struct ProductTraits<Product::RX> {
+    static constexpr std::string_view PI = "RX";
+    static constexpr int FIELDS[] = {field("BY"), field("VS"), field("SW"), field("PR"), field("IN"), field("GP"), field("MS")};
+    static constexpr size_t BYTES_PER_PIXEL = 1;
+    static constexpr bool AMOUNT = false;   // dBZ, not mm
+
+    static void decode(const char* src, size_t n, float, float* values, uint8_t* mask)
+    {
+        decodeRVP6(src, n, values, mask);
+    }
+};
+
+// every field table resolves and ends with "MS", as the text follows it
+template <class T>
+constexpr bool validFields()
+{
+    for (int k : T::FIELDS)
+        if (k < 0)
+            return false;
+    return METAINFO[T::FIELDS[std::size(T::FIELDS) - 1]].getKey() == "MS";
+}
+
+static_assert(validFields<ProductTraits<Product::RV>>() && validFields<ProductTraits<Product::RW>>() &&
+    validFields<ProductTraits<Product::RY>>() && validFields<ProductTraits<Product::YW>>() &&
+    validFields<ProductTraits<Product::RX>>(), "ProductTraits: malformed field table!");
+
+
+/* DISPATCH ----------------------------------------------------------------- */
+
+// f(ProductTraits<P>()) for the product P with ID pi; throws
+// std::invalid_argument for other IDs
+template <class F>
+decltype(auto) withProduct(std::string_view pi, F&& f)
+{
+    switch (pi.size() == 2 ? keyCode(pi[0], pi[1]) : -1)
+    {
+        case keyCode('R', 'V'): return f(ProductTraits<Product::RV>());
+        case keyCode('R', 'W'): return f(ProductTraits<Product::RW>());
+        case keyCode('R', 'Y'): return f(ProductTraits<Product::RY>());
+        case keyCode('Y', 'W'): return f(ProductTraits<Product::YW>());
+        case keyCode('R', 'X'): return f(ProductTraits<Product::RX>());
+        default:
+            throw std::invalid_argument("withProduct: unknown product '" + std::string(pi) + "'!");
+    }
+}
+
+// payload bytes per pixel of product pi
+inline size_t bytesPerPixel(std::string_view pi)
+{
+    return withProduct(pi, [](auto t) { return decltype(t)::BYTES_PER_PIXEL; });
+}
+
+// whether product pi holds precipitation amounts, i.e. may be accumulated
+inline bool isAmount(std::string_view pi)
+{
+    return withProduct(pi, [](auto t) { return decltype(t)::AMOUNT; });
+}
+
+// payload bytes of the file with header h
+inline size_t payloadBytes(const Header& h)
+{
+    return size_t(h.getRows()) * h.getCols() * bytesPerPixel(h.getPI());
+}
+
+// decode n pixels of product pi at src (n * bytesPerPixel(pi) bytes)
+inline void decodeProduct(std::string_view pi, const char* src, size_t n, float factor, float* values, uint8_t* mask)
+{
+    withProduct(pi, [&](auto t) { decltype(t)::decode(src, n, factor, values, mask); });
+}
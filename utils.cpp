@@ -1,160 +1,292 @@
-#include <fstream>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "classes.h"
 #include "logger.h"
+#include "traits.h"
 #include "utils.h"
 
 using namespace std;
 
 
-long findETX(std::ifstream& f) {
+long findETX(const char* b, size_t n) {
 
     // Find 0x03 (ETX - end of text) byte that indicates the ASCII header's end
     // and return its index. As the whole header is ASCII-encoded, this byte can
     // occur only one.
 
-    char b;     // byte
-    long i = 0; // index
+    // NOTE: memchr scans the mapped bytes word- or vector-wise, instead of 
+    // issuing one stream read per byte
+    const void* p = std::memchr(b, 0x03, n);
 
-    while (f.read(&b, 1)) {  // Read one byte at a time
-        
-        // if byte b is 0x03, return index i
-        if (b == static_cast<char>(0x03)) {  
-            LOG4CXX_INFO(Logger::get(), "findETX: identified ETX at byte " << i);
-            return i; 
-        }
-
-        // otherwise, increment index
-        i++;
+    // return -1 if not found
+    if (p == nullptr) {
+        LOG_INFO("findETX: unable to identify ETX! returning -1");
+        return -1;
     }
 
-    // return -1 if not found
-    LOG4CXX_INFO(Logger::get(), "findETX: unable to identify ETX! returning -1");
-    return -1;  
+    // otherwise, the index is the distance to the start of the buffer
+    long i = static_cast<const char*>(p) - b;
+
+    LOG_INFO("findETX: identified ETX at byte " << i);
+    return i;
 }
 
 
-std::vector<char> getHeader(std::ifstream& f, size_t n) {
+std::string_view getHeader(const MappedFile& f, size_t n) {
 
-    // Reads in and returns bytes 0 to n from file n.
+    // Returns a view of bytes 0 to n of the mapped file f. 
 
-    // init vector (resizable array) of type char for storing n bytes from f
-    std::vector<char> buffer(n);
+    // NOTE: nothing is copied, hence the view is only valid as long as f is!
+    return std::string_view(f.data(), n);
 
-    // move reader head to start of file
-    f.seekg(0);   
+}
 
-    // read n bytes
-    f.read(buffer.data(), n); 
 
-    // return the bytes
-    return buffer;
+std::tuple<const MetaInfo*, std::string_view> parse(std::string_view b, long i) {
 
-}
+    /*
+    Helper function for parsing "non-positional" part of ASCII header.
 
+    Reads in two bytes of b at position `b.begin() + i` and infers the field 
+    from the compile-time table `METAINFO`.
+
+    Then, reads in the appropriate number of bytes of that field and returns the
+    field as well as the value bytes.
 
-std::map<std::string, MetaInfo> getMetaInfo()
-{
-    // Creates and returns a key-value mapping for processing the ASCII 
-    // header's structure.
 
-    // NOTE: makes use of https://en.wikipedia.org/wiki/Command_pattern
+    Arguments
+        b   VIEW of the header bytes (not copied)
+        i   current byte Index
     
-    std::map<std::string, MetaInfo> mapping = {
+    Returns
+        a tuple (C++17!!) of a pointer into `METAINFO` (nullptr for unknown 
+        keys) and a view of the value bytes
 
-        // "Kennung BY: Produktlänge in byte"
-        {"BY", MetaInfo("BY", 2, 7, 0, &Header::setBY)},
-        
-        // "Kennung VS: Format-Version"
-        {"VS", MetaInfo("VS", 2, 2, 0, &Header::setVS)},
-        
-        // "Kennung SW: Software-Version"
-        {"SW", MetaInfo("SW", 2, 8, 1, &Header::setSW)},
-        
-        // "Kennung PR: Genauigkeit der Daten (PRecision)"
-        {"PR", MetaInfo("PR", 2, 4, 1, &Header::setPR)},
-        
-        // "Kennung INT: Intervalldauer in Minuten" - caution: key has length 3!
-        {"IN", MetaInfo("IN", 3, 4, 0, &Header::setIN)},
+    C++17
+        returns a tuple, see https://stackoverflow.com/a/16516315
+    */
 
-        // "Kennung GP: Anzahl der Pixel (e.g. `1200x1100`)"
-        {"GP", MetaInfo("GP", 2, 9, 0, &Header::setGP)},
-        
-        // "Kennung VV: Vorhersagezeitpunkt in Minuten nach der Messung (e.g. `075`)"
-        {"VV", MetaInfo("VV", 2, 3, 1, &Header::setVV)},
-        
-        // "Kennung MF: Modulflags Dezimalwert der entsprechenden Binärdarstellung"
-        {"MF", MetaInfo("MF", 2, 8, 1, &Header::setMF)},
-        
-        // "Kennung MS: Textlaenge m"
-        {"MS", MetaInfo("MS", 2, 3, 0, &Header::setMS)},
+    LOG_DEBUG("parse: called with i = " << i);
 
-    };
+    if (i < 0 || b.size() < size_t(i) + 2)
+        throw std::invalid_argument("parse: no key at byte " + std::to_string(i) + "!");
+
+    // dispatch on the first two bytes; no string is built for the lookup
+    int k = findMetaInfo(b[i], b[i+1]);
+
+    if (k < 0)
+    {
+        LOG_ERROR("parse: key = " << b.substr(i, 2) << " not found in METAINFO!");
+        return {nullptr, std::string_view()};
+    }
+
+    const MetaInfo* m = &METAINFO[k];
+
+    LOG_DEBUG("parse: found key = " << m->getKey());
 
-    return mapping;
+    if (b.size() < size_t(i) + m->getLen())
+        throw std::invalid_argument("parse: header ends within field " + std::string(m->getKey()) + "!");
+
+    // payload starts after the key bytes; return Mapping and view of payload
+    return {m, b.substr(i + m->getKeyLen(), m->getValLen() + m->getValIgn())};
 
 }
 
 
-std::tuple<MetaInfo, std::vector<char>> parse(std::vector<char> b, long i, const std::map<std::string, MetaInfo>& mi) {
+template <class T>
+static void parseFields(std::string_view hb, Header& h) {
 
     /*
-    Helper function for parsing "non-positional" part of ASCII header.
+    Parses the keyed part of the ASCII header bytes `hb` of product T into h.
 
-    Reads in two bytes of b at position `b.begin() + i` and infers the field 
-    from the key-value mappings in `m`.
+    "... der Parser (sollte) so implementiert sein, dass er den Inhalt (...)
+     anhand der jeweils einleitenden Kennung verarbeitet."
 
-    Then, reads in the appropriate number of bytes of that field and returns the
-    field as well as the value bytes.
+    Hence every key is checked: the field that T::FIELDS expects next is read
+    directly (the common case, inlined per product), any other key, e.g. of
+    another format version, is looked up in METAINFO. "MS" and its text end
+    the header.
+    */
+
+    // start looking for identifiers at byte 17, read until `etxIndex`
+    long i = 17;
+    size_t next = 0;
+
+    // at most one key-value pair per METAINFO entry
+    for (size_t j = 0; j < METAINFO_SIZE; j++)
+    {
+        const MetaInfo* mm = nullptr;
+        std::string_view by;
+
+        if (next < std::size(T::FIELDS))
+        {
+            const MetaInfo& e = METAINFO[T::FIELDS[next]];
+            if (hb.size() >= size_t(i) + e.getLen() && hb[i] == e.getKey()[0] && hb[i+1] == e.getKey()[1])
+            {
+                mm = &e;
+                by = hb.substr(i + e.getKeyLen(), e.getValLen() + e.getValIgn());
+                next++;
+            }
+        }
+
+        // get mapping and bytes
+        if (mm == nullptr)
+            std::tie(mm, by) = parse(hb, i);
 
+        if (mm == nullptr)
+            throw std::invalid_argument("parseHeader: unknown key at byte " + std::to_string(i) + "!");
+
+        LOG_DEBUG("parseHeader: getKey : " << mm->getKey() << " (" << mm->getKeyLen() << "+" << mm->getValLen() << "=" << mm->getLen() << ")");
+        LOG_DEBUG("parseHeader: buff   : " << by);
+        LOG_DEBUG("parseHeader: i: " << i << " -> " << (i+mm->getLen()));
+        
+        // get setter function from mapping and assign respective value
+        MetaInfo::SetterFunction setterFunc = mm->getSetter();
+        (h.*setterFunc)(by); 
+
+        // add number of processed bytes to index i
+        i += mm->getLen();
+
+
+        // in case we arrived at "MS", read in the subsequent text
+        if (mm->getKey() == "MS")
+        {
+            // get length of text in byte
+            int textLen = h.getMS();
+
+            if (hb.size() < size_t(i) + textLen)
+                throw std::invalid_argument("parseHeader: header ends within text!");
+
+            // set header attribute from a view of the text
+            h.setText(hb.substr(i, textLen));
+
+            LOG_DEBUG("parseHeader: text : " << h.getText());
+
+            LOG_DEBUG("parseHeader: i: " << i << " -> " << (i+textLen));
+
+            return;
+        }
+
+    }
+
+    // no "MS" within METAINFO_SIZE fields, e.g. a repeated key
+    throw std::invalid_argument("parseHeader: no MS field!");
+}
+
+
+void parseHeader(std::string_view hb, Header& h) {
+
+    /*
+    Parses the ASCII header bytes `hb` (up to, but excluding ETX) into h.
+
+    The first 17 bytes are positional ("Produktkennung", time stamp and 
+    "WMO-Nummer"), all other fields are identified by their key, see 
+    `METAINFO` and the field table of the product (traits.h).
 
     Arguments
-        b   header bytes vector
-        i   current byte Index
-        mi  CONST REFERENCE to string-to-MetaInfo map (for performance reasons)
+        hb          VIEW of the header bytes (see `getHeader`)
+        h           header to fill
+    */
+
+    // a reused header must not keep fields (e.g. VV, INT, text) of the 
+    // previous file
+    h.clear();
+
+    /* handle fixed-positioned meta data ------------------------------------ */
     
-    Returns
-        a tuple (C++17!!) of Mapping and byte-vector
+    // the positional part spans 17 bytes
+    if (hb.size() < 17)
+        throw std::invalid_argument("parseHeader: header must be at least 17 bytes!");
 
-    C++17
-        returns a tuple, see https://stackoverflow.com/a/16516315
-    */
+    // "Produktkennung"
+    
+    // set header attribute from bytes at position 1 and 2
+    h.setPI(hb.substr(0, 2));
+
+
+    // time stamp 
+    // → read 3 "data fields" at once, then split and build time stamp
+    std::string_view bytes = hb.substr(
+        2,          // begin reading after "Produktkennung"
+        6+5+4);     // read 6 ts A + 5 WMO + 4 ts B bytes
+
+
+    // extract and create timestamp in "YYMMDDhhmm" format
+    const char ts[10] = {
+        bytes[13], bytes[14], // YY
+        bytes[11], bytes[12], // MM
+        bytes[0], bytes[1],   // DD
+        bytes[2], bytes[3],   // hh
+        bytes[4], bytes[5]};  // mm
+    
+    // set header attribute
+    h.setTS(std::string_view(ts, 10));
+    
 
-   LOG4CXX_INFO(Logger::get(), "parse: called with i = " << i);
+    // "WMO Nummer"
 
-   // init Mapping instance representing field;
-    MetaInfo m;
+    // set header attribute: offset is 6B from ts A, length is 5B
+    h.setWN(hb.substr(8, 5));
+    
 
-    // read in the first two bytes and cast to library string
-    const std::string key(b.begin()+i, b.begin()+i+2);
+    /* LOGGING ------------------------------------------------------------- */
     
-    // try to infer header field type
-    try {
-        m = mi.at(key);
+    LOG_DEBUG("parseHeader: ProductId = " << h.getPI());
+    LOG_DEBUG("parseHeader: timestamp = " << h.getTS());
+    LOG_DEBUG("parseHeader: WMO       = " << h.getWN());
+    
+    
+    /* read non-positional data --------------------------------------------- */
 
-        LOG4CXX_INFO(Logger::get(), "parse: found key = " << key);
+    // which keyed fields follow depends on the product, see traits.h
+    withProduct(h.getPI(), [&](auto t) { parseFields<decltype(t)>(hb, h); });
 
-        // start reading after the key bytes 
-        auto start = b.begin()+i+m.getKeyLen(); 
+    return;
+}
 
-        // determine payload bytes to read
-        auto end = b.begin()+i+m.getLen();
 
-        // read payload into `buff`
-        std::vector<char> buff(start, end);
+uint64_t hashBytes(const char* b, size_t n, uint64_t seed) {
 
-        // finally, return Mapping and payload
-        return {m, buff};
+    // 64-bit hash of n bytes at b in the style of xxHash64: one multiply-rotate
+    // round per 8 bytes and a final avalanche. Not cryptographic, but one pass
+    // at memory speed, and good enough to tell grids and tiles apart. Chain
+    // calls through `seed` to hash non-contiguous data.
+    const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+
+    auto mix = [&](uint64_t h, uint64_t w) {
+        h += w * P2;
+        h = (h << 31) | (h >> 33);
+        return h * P1;
+    };
+
+    uint64_t h = mix(seed + P1, n);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, b + i, 8);
+        h = mix(h, w);
     }
-    catch (const std::out_of_range&) 
-    {
-        LOG4CXX_ERROR(Logger::get(), "parse: key = " << key << "not found in Mapping m!");
 
-        std::vector<char> x {0};
-        return {m, x};
+    // the last 1 to 7 bytes
+    if (i < n) {
+        uint64_t w = 0;
+        std::memcpy(&w, b + i, n - i);
+        h = mix(h, w);
     }
 
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P1;
+    h ^= h >> 32;
+    return h;
 }
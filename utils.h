@@ -1,12 +1,108 @@
 #pragma once
 
-#include <fstream>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <tuple>
 
 #include "classes.h"
 
-long findETX(std::ifstream& f);
-std::vector<char> getHeader(std::ifstream& f, size_t n);
-std::map<std::string, MetaInfo> getMetaInfo();
-std::tuple<MetaInfo, std::vector<char>> parse(std::vector<char> b, long i, const std::map<std::string, MetaInfo>& m);
+
+/* METAINFO TABLE ----------------------------------------------------------- */
+
+// Key-value layout for processing the ASCII header's structure, resolved at
+// compile time: no allocation and no tree walk at runtime.
+
+// NOTE: makes use of https://en.wikipedia.org/wiki/Command_pattern
+
+inline constexpr MetaInfo METAINFO[] = {
+
+    // "Kennung BY: Produktlänge in byte"
+    MetaInfo("BY", 2, 7, 0, &Header::setBY),
+
+    // "Kennung VS: Format-Version"
+    MetaInfo("VS", 2, 2, 0, &Header::setVS),
+
+    // "Kennung SW: Software-Version"
+    MetaInfo("SW", 2, 8, 1, &Header::setSW),
+
+    // "Kennung PR: Genauigkeit der Daten (PRecision)"
+    MetaInfo("PR", 2, 4, 1, &Header::setPR),
+
+    // "Kennung INT: Intervalldauer in Minuten" - caution: key has length 3!
+    MetaInfo("IN", 3, 4, 0, &Header::setIN),
+
+    // "Kennung GP: Anzahl der Pixel (e.g. `1200x1100`)"
+    MetaInfo("GP", 2, 9, 0, &Header::setGP),
+
+    // "Kennung VV: Vorhersagezeitpunkt in Minuten nach der Messung (e.g. `075`)"
+    MetaInfo("VV", 2, 3, 1, &Header::setVV),
+
+    // "Kennung MF: Modulflags Dezimalwert der entsprechenden Binärdarstellung"
+    MetaInfo("MF", 2, 8, 1, &Header::setMF),
+
+    // "Kennung MS: Textlaenge m" - followed by the text, hence must be last!
+    MetaInfo("MS", 2, 3, 0, &Header::setMS),
+
+};
+
+// number of key-value pairs following the positional part of the header
+inline constexpr size_t METAINFO_SIZE = std::size(METAINFO);
+
+// Upper bound of an RV header: 17 positional bytes, nine keyed fields and a
+// text of at most 999 bytes fit well within it.
+inline constexpr size_t HEADER_MAX = 4096;
+
+
+// combine the two key bytes into one integer for switch-based dispatch
+constexpr int keyCode(char a, char b) { return (static_cast<unsigned char>(a) << 8) | static_cast<unsigned char>(b); }
+
+// index into METAINFO for the key bytes a and b, or -1 for unknown keys
+constexpr int findMetaInfo(char a, char b)
+{
+    switch (keyCode(a, b))
+    {
+        case keyCode('B', 'Y'): return 0;
+        case keyCode('V', 'S'): return 1;
+        case keyCode('S', 'W'): return 2;
+        case keyCode('P', 'R'): return 3;
+        case keyCode('I', 'N'): return 4;
+        case keyCode('G', 'P'): return 5;
+        case keyCode('V', 'V'): return 6;
+        case keyCode('M', 'F'): return 7;
+        case keyCode('M', 'S'): return 8;
+        default: return -1;
+    }
+}
+
+// compile-time check of the table: sane lengths, the switch above resolves
+// every key to its own entry, and "MS" (followed by the text) comes last
+constexpr bool validMetaInfo()
+{
+    for (size_t k = 0; k < METAINFO_SIZE; k++)
+    {
+        const MetaInfo& m = METAINFO[k];
+
+        if (m.getKeyLen() < 2 || m.getKeyLen() > 3 || m.getValLen() <= 0 || m.getValIgn() < 0)
+            return false;
+        if (m.getSetter() == nullptr)
+            return false;
+        if (findMetaInfo(m.getKey()[0], m.getKey()[1]) != static_cast<int>(k))
+            return false;
+    }
+    return METAINFO[METAINFO_SIZE-1].getKey() == "MS";
+}
+
+static_assert(validMetaInfo(), "METAINFO: malformed header field layout!");
+
+
+/* FUNCTIONS ---------------------------------------------------------------- */
+
+long findETX(const char* b, size_t n);
+std::string_view getHeader(const MappedFile& f, size_t n);
+std::tuple<const MetaInfo*, std::string_view> parse(std::string_view b, long i);
+void parseHeader(std::string_view hb, Header& h);
+uint64_t hashBytes(const char* b, size_t n, uint64_t seed = 0);
@@ -0,0 +1,177 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "batch.h"
+#include "logger.h"
+#include "watch.h"
+
+using namespace std;
+
+
+/* HEADER CACHE ------------------------------------------------------------- */
+
+static struct timespec mtimeOf(const struct stat& st)
+{
+    // modification time with nanoseconds; the member name differs on macOS
+#ifdef __APPLE__
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+bool HeaderCache::isStale(const std::string& path, const struct stat& st) const
+{
+    auto it = entries.find(path);
+    if (it == entries.end())
+        return true;
+
+    const Entry& e = it->second;
+    struct timespec mtime = mtimeOf(st);
+    return e.inode != st.st_ino || e.mtime.tv_sec != mtime.tv_sec || e.mtime.tv_nsec != mtime.tv_nsec;
+}
+
+void HeaderCache::put(const std::string& path, const struct stat& st, const Result& r)
+{
+    entries[path] = Entry{st.st_ino, mtimeOf(st), r};
+}
+
+void HeaderCache::erase(const std::string& path) { entries.erase(path); }
+
+const Result* HeaderCache::get(const std::string& path) const
+{
+    auto it = entries.find(path);
+    return it == entries.end() ? nullptr : &it->second.result;
+}
+
+size_t HeaderCache::size() const { return entries.size(); }
+
+
+/* WATCH -------------------------------------------------------------------- */
+
+static std::atomic<bool> stopped{false};
+
+static void onSignal(int) { stopped = true; }
+
+static void ingest(HeaderCache& cache, const std::string& path, bool decode, const std::function<void(const Result&)>& emit)
+{
+    // parse path if it is a regular file that is new or changed
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+
+    if (!cache.isStale(path, st)) {
+        LOG_DEBUG("watch: " << path << " unchanged");
+        return;
+    }
+
+    Result r = processFile(path, decode);
+    cache.put(path, st, r);
+    emit(r);
+}
+
+void watchDirectory(const std::string& dir, bool decode, const std::function<void(const Result&)>& emit)
+{
+    if (!std::filesystem::is_directory(dir))
+        throw std::invalid_argument("watch: " + dir + " is not a directory!");
+
+    stopped = false;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    HeaderCache cache;
+
+#ifdef __linux__
+    // subscribe before the initial scan, so no file can slip through in between
+    int fd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0)
+        throw std::runtime_error("watch: inotify_init1 failed");
+
+    if (::inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+        ::close(fd);
+        throw std::runtime_error("watch: unable to watch " + dir);
+    }
+#endif
+
+    // initial scan: everything already present, in TS/VV order
+    std::vector<std::string> files = collectFiles({dir});
+    for (const Result& r : processBatch(files, decode, 0)) {
+        struct stat st;
+        if (::stat(std::string(r.header.getFN()).c_str(), &st) == 0)
+            cache.put(std::string(r.header.getFN()), st, r);
+        emit(r);
+    }
+
+    LOG_INFO("watch: watching " << dir << " (" << cache.size() << " files cached)");
+
+#ifdef __linux__
+    // events are variable-length records; the buffer must be aligned for them
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (!stopped)
+    {
+        // wake up regularly to check for signals
+        struct pollfd p = {fd, POLLIN, 0};
+        if (::poll(&p, 1, 500) <= 0)
+            continue;
+
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            continue;
+
+        for (char* e = buffer; e < buffer + n; )
+        {
+            const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(e);
+            e += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->len == 0)
+                continue;
+
+            std::string path = (std::filesystem::path(dir) / ev->name).string();
+
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+                cache.erase(path);
+            else
+                ingest(cache, path, decode, emit);
+        }
+    }
+
+    ::close(fd);
+#else
+    // no inotify: compare the directory against the cache once per second
+    while (!stopped)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::set<std::string> present;
+        for (const std::string& path : collectFiles({dir})) {
+            present.insert(path);
+            ingest(cache, path, decode, emit);
+        }
+
+        // NOTE: files being written may be picked up early; their mtime changes
+        // once more when writing finishes, so they are parsed again then
+        for (const std::string& path : files)
+            if (!present.count(path))
+                cache.erase(path);
+        files.assign(present.begin(), present.end());
+    }
+#endif
+
+    LOG_INFO("watch: stopped");
+}
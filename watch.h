@@ -0,0 +1,50 @@
+#pragma once
+
+#include <ctime>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include "batch.h"
+
+
+/* HEADER CACHE ------------------------------------------------------------- */
+
+// parsed results keyed by path; an entry is only valid as long as inode and
+// modification time of the file match those seen when it was parsed
+
+class HeaderCache {
+private:
+    struct Entry {
+        ino_t inode;
+        struct timespec mtime;
+        Result result;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+
+public:
+    // true if path is not cached or was replaced/modified since
+    bool isStale(const std::string& path, const struct stat& st) const;
+
+    void put(const std::string& path, const struct stat& st, const Result& r);
+    void erase(const std::string& path);
+
+    // cached result for path, or nullptr
+    const Result* get(const std::string& path) const;
+
+    size_t size() const;
+};
+
+
+/* WATCH -------------------------------------------------------------------- */
+
+// Parse all files already in dir, then wait for new or changed files and parse
+// each of them as soon as it is closed after writing (or moved into dir). Every
+// result is handed to `emit`; files whose inode and mtime are unchanged are not
+// parsed again. Runs until SIGINT or SIGTERM.
+//
+// NOTE: uses inotify on Linux and polls the directory once per second elsewhere
+void watchDirectory(const std::string& dir, bool decode, const std::function<void(const Result&)>& emit);
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "classes.h"
+#include "cube.h"
+#include "logger.h"
+#include "traits.h"
+#include "zones.h"
+
+using namespace std;
+
+
+/* REGION INDEX ------------------------------------------------------------- */
+
+// constructor A
+RegionIndex::RegionIndex() : rows(0), cols(0), offsets(1, 0) {}
+
+// destructor: for now empty, as vectors clean up after themselves
+RegionIndex::~RegionIndex() {}
+
+const int RegionIndex::getRows() const { return rows; }
+const int RegionIndex::getCols() const { return cols; }
+const size_t RegionIndex::getRegions() const { return ids.size(); }
+const uint32_t RegionIndex::getId(size_t k) const { return ids[k]; }
+const size_t RegionIndex::getSize(size_t k) const { return offsets[k+1] - offsets[k]; }
+const uint32_t* RegionIndex::getPixels(size_t k) const { return pixels.data() + offsets[k]; }
+
+
+RegionIndex buildRegionIndex(int rows, int cols, std::vector<std::pair<uint32_t, uint32_t>> members)
+{
+    const size_t size = size_t(rows) * cols;
+
+    for (const auto& m : members)
+        if (m.second >= size)
+            throw std::invalid_argument("buildRegionIndex: pixel " + std::to_string(m.second) + " of region " + std::to_string(m.first) + " is outside the grid!");
+
+    RegionIndex index;
+    index.rows = rows;
+    index.cols = cols;
+
+    uint32_t maxId = 0;
+    for (const auto& m : members)
+        maxId = std::max(maxId, m.first);
+
+    if (maxId > (1u << 20))
+    {
+        // sparse IDs: by region, then pixel
+        std::sort(members.begin(), members.end());
+
+        for (const auto& m : members)
+        {
+            if (index.ids.empty() || index.ids.back() != m.first) {
+                index.ids.push_back(m.first);
+                index.offsets.push_back(index.offsets.back());
+            }
+            index.pixels.push_back(m.second);
+            index.offsets.back()++;
+        }
+    }
+    else
+    {
+        // counting sort on the ID: linear, and stable, hence the pixels of a
+        // raster (read in order) need no sorting afterwards
+        std::vector<uint32_t> slot(size_t(maxId) + 2, 0);
+        for (const auto& m : members)
+            slot[m.first + 1]++;
+
+        for (uint32_t id = 0; id <= maxId; id++) {
+            if (slot[id + 1] > 0) {
+                index.ids.push_back(id);
+                index.offsets.push_back(index.offsets.back() + slot[id + 1]);
+            }
+            slot[id + 1] += slot[id];
+        }
+
+        index.pixels.resize(members.size());
+        for (const auto& m : members)
+            index.pixels[slot[m.first]++] = m.second;
+
+        for (size_t k = 0; k < index.ids.size(); k++) {
+            uint32_t* p = index.pixels.data() + index.offsets[k];
+            if (!std::is_sorted(p, p + index.getSize(k)))
+                std::sort(p, p + index.getSize(k));
+        }
+    }
+
+    // drop duplicate pixels within each region and compact
+    size_t out = 0;
+    for (size_t k = 0; k < index.ids.size(); k++)
+    {
+        size_t begin = index.offsets[k];
+        size_t end = index.offsets[k + 1];
+        size_t first = out;
+        index.offsets[k] = uint32_t(out);
+
+        for (size_t i = begin; i < end; i++)
+            if (out == first || index.pixels[i] != index.pixels[out - 1])
+                index.pixels[out++] = index.pixels[i];
+    }
+    index.offsets.back() = uint32_t(out);
+    index.pixels.resize(out);
+
+    return index;
+}
+
+
+static std::vector<std::pair<uint32_t, uint32_t>> readRaster(const std::string& path, size_t size)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::vector<unsigned char> raw(size * 2);
+    if (!in.read(reinterpret_cast<char*>(raw.data()), raw.size()))
+        throw std::runtime_error("loadRegions: unable to read " + path);
+
+    std::vector<std::pair<uint32_t, uint32_t>> members;
+    for (size_t p = 0; p < size; p++) {
+        uint32_t id = raw[2*p] | (raw[2*p+1] << 8);
+        if (id != 0)
+            members.emplace_back(id, uint32_t(p));
+    }
+    return members;
+}
+
+static std::vector<std::pair<uint32_t, uint32_t>> readList(const std::string& path, int rows, int cols)
+{
+    std::ifstream in(path);
+    std::vector<std::pair<uint32_t, uint32_t>> members;
+    std::string line;
+
+    for (size_t n = 1; std::getline(in, line); n++)
+    {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        std::istringstream ss(line);
+        long id, row, col;
+        if (!(ss >> id >> row >> col) || id < 0 || row < 0 || col < 0 || row >= rows || col >= cols)
+            throw std::invalid_argument("loadRegions: malformed line " + std::to_string(n) + " in " + path + "!");
+
+        members.emplace_back(uint32_t(id), uint32_t(row * cols + col));
+    }
+    return members;
+}
+
+RegionIndex loadRegions(const std::string& path, int rows, int cols)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+        throw std::runtime_error("loadRegions: unable to open " + path);
+
+    const size_t size = size_t(rows) * cols;
+    bool raster = (size_t(in.tellg()) == size * 2);
+
+    RegionIndex index = buildRegionIndex(rows, cols, raster ? readRaster(path, size) : readList(path, rows, cols));
+
+    [[maybe_unused]] double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("loadRegions: " << index.getRegions() << " regions from " << (raster ? "raster " : "pixel list ") << path << " in " << s << "s");
+
+    return index;
+}
+
+size_t regionsFor(std::vector<RegionIndex>& loaded, const std::string& path, int rows, int cols)
+{
+    for (size_t k = 0; k < loaded.size(); k++)
+        if (loaded[k].getRows() == rows && loaded[k].getCols() == cols)
+            return k;
+
+    loaded.push_back(loadRegions(path, rows, cols));
+    return loaded.size() - 1;
+}
+
+
+/* ZONAL STATISTICS --------------------------------------------------------- */
+
+double ZoneStats::mean() const { return valid ? sum / valid : std::numeric_limits<double>::quiet_NaN(); }
+double ZoneStats::coverage() const { return pixels ? double(valid) / pixels : 0.0; }
+
+
+static inline void add(ZoneStats& z, float v)
+{
+    // NaN (no data) fails the comparison
+    if (!(v == v))
+        return;
+
+    z.valid++;
+    z.sum += v;
+    if (v > 0.0f)
+        z.wet++;
+    if (z.valid == 1 || v > z.max)
+        z.max = v;
+}
+
+std::vector<ZoneStats> zonalStats(const Cube& c, const RegionIndex& index, unsigned jobs)
+{
+    if (!isAmount(c.getPI()))
+        throw std::invalid_argument("zonalStats: product " + std::string(c.getPI()) + " holds no precipitation amounts!");
+    if (c.getRows() != index.getRows() || c.getCols() != index.getCols())
+        throw std::invalid_argument("zonalStats: regions must be defined on the " + std::to_string(c.getRows()) + "x" + std::to_string(c.getCols()) + " grid of the cube!");
+
+    const size_t steps = size_t(c.getSteps());
+    const size_t size = size_t(c.getRows()) * c.getCols();
+    const float* values = c.getValues();
+
+    std::vector<ZoneStats> stats(index.getRegions() * steps);
+
+    // every region is owned by one worker; its pixels are read in memory order
+    parallelFor(index.getRegions(), jobs, [&](size_t k) {
+        ZoneStats* z = stats.data() + k * steps;
+        const uint32_t* pixels = index.getPixels(k);
+        const size_t n = index.getSize(k);
+
+        for (size_t s = 0; s < steps; s++)
+            z[s].pixels = uint32_t(n);
+
+        if (c.getLayout() == Layout::PIXEL_MAJOR)
+        {
+            // the series of a pixel is contiguous: one read per pixel and run
+            for (size_t i = 0; i < n; i++) {
+                const float* series = values + size_t(pixels[i]) * steps;
+                for (size_t s = 0; s < steps; s++)
+                    add(z[s], series[s]);
+            }
+        }
+        else
+        {
+            for (size_t s = 0; s < steps; s++) {
+                const float* grid = values + s * size;
+                for (size_t i = 0; i < n; i++)
+                    add(z[s], grid[pixels[i]]);
+            }
+        }
+    });
+
+    LOG_INFO("zonalStats: " << index.getRegions() << " regions over " << steps << " steps of run " << c.getTS());
+
+    return stats;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cube.h"
+
+
+/* REGION INDEX ------------------------------------------------------------- */
+
+// Regions of the GP grid in compressed sparse row (CSR) form: the pixels of
+// region k are pixels[offsets[k]] to pixels[offsets[k+1] - 1], each given as
+// `row * cols + col` and sorted ascending, so a region is read in memory order.
+// Regions may overlap; a pixel may belong to any number of them.
+
+class RegionIndex {
+private:
+    int rows;
+    int cols;
+
+    // region IDs, ascending; region k has ID ids[k]
+    std::vector<uint32_t> ids;
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> pixels;
+
+    friend RegionIndex buildRegionIndex(int rows, int cols, std::vector<std::pair<uint32_t, uint32_t>> members);
+
+public:
+    RegionIndex();
+    ~RegionIndex();
+
+    const int getRows() const;
+    const int getCols() const;
+
+    const size_t getRegions() const;
+    const uint32_t getId(size_t k) const;
+
+    // pixels of region k
+    const size_t getSize(size_t k) const;
+    const uint32_t* getPixels(size_t k) const;
+};
+
+// index from (region ID, pixel) pairs; duplicate pairs are dropped, pixels
+// outside the grid throw std::invalid_argument
+RegionIndex buildRegionIndex(int rows, int cols, std::vector<std::pair<uint32_t, uint32_t>> members);
+
+// Load regions for a rows x cols grid from path, which is either
+//  - a raster: rows * cols little-endian uint16 region IDs in payload order,
+//    0 for pixels outside every region (detected by its size), or
+//  - a pixel list: one `<id> <row> <col>` per line, `#` starts a comment.
+RegionIndex loadRegions(const std::string& path, int rows, int cols);
+
+// Index in `loaded` of the regions of path for a rows x cols grid; the regions
+// are loaded and appended on first use of a grid, so runs of several grids
+// share one file. Throws as `loadRegions` if the file does not fit the grid.
+size_t regionsFor(std::vector<RegionIndex>& loaded, const std::string& path, int rows, int cols);
+
+
+/* ZONAL STATISTICS --------------------------------------------------------- */
+
+// statistics of one region in one step; no-data pixels count towards `pixels`
+// only, hence `mean` is over valid pixels and NaN if there are none
+
+struct ZoneStats {
+    uint32_t pixels = 0;
+    uint32_t valid = 0;
+    uint32_t wet = 0;
+    double sum = 0;
+    float max = 0;
+
+    double mean() const;
+
+    // fraction of the region's pixels with data; 0 for a region without pixels
+    double coverage() const;
+};
+
+// statistics of every region in every step of the cube, in one pass over the
+// index on `jobs` worker threads (0: one per core); the result is region-major,
+// i.e. region k in step s is at [k * steps + s]
+std::vector<ZoneStats> zonalStats(const Cube& c, const RegionIndex& index, unsigned jobs);